@@ -40,6 +40,8 @@ static gboolean do_version    = FALSE;
 
 static gboolean do_query      = FALSE;
 static gboolean do_time       = FALSE;
+static gboolean do_auth_stats = FALSE;
+static gboolean do_stats      = FALSE;
 
 static GOptionEntry entries [] = {
 	{ "exit", 0, 0, G_OPTION_ARG_NONE, &do_quit,
@@ -48,6 +50,10 @@ static GOptionEntry entries [] = {
 	  N_("Query the state of the screensaver"), NULL },
 	{ "time", 't', 0, G_OPTION_ARG_NONE, &do_time,
 	  N_("Query the length of time the screensaver has been active"), NULL },
+	{ "auth-stats", 0, 0, G_OPTION_ARG_NONE, &do_auth_stats,
+	  N_("Show how long unlocking the screen has been taking"), NULL },
+	{ "stats", 0, 0, G_OPTION_ARG_NONE, &do_stats,
+	  N_("Show the screensaver's performance counters"), NULL },
 	{ "lock", 'l', 0, G_OPTION_ARG_NONE, &do_lock,
 	  N_("Tells the running screensaver process to lock the screen immediately"), NULL },
 	{ "activate", 'a', 0, G_OPTION_ARG_NONE, &do_activate,
@@ -259,6 +265,87 @@ do_command (GDBusConnection *connection)
 		}
 	}
 
+	if (do_auth_stats) {
+		GVariant     *body;
+		GVariantIter *iter;
+		const char   *name;
+		guint32       count;
+		gint64        total;
+		gint64        max;
+		gint64        last;
+
+		reply = screensaver_send_message_void (connection, "GetStats", TRUE);
+		if (reply == NULL) {
+			g_message ("Did not receive a reply from the screensaver.");
+			goto done;
+		}
+
+		body = g_dbus_message_get_body (reply);
+		g_variant_get (body, "(a(suxxx))", &iter);
+
+		while (g_variant_iter_loop (iter, "(&suxxx)", &name, &count, &total, &max, &last)) {
+			if (count == 0) {
+				continue;
+			}
+
+			g_print ("%-24s %6u  mean %8.1f ms  max %8.1f ms  last %8.1f ms\n",
+				 name,
+				 count,
+				 total / (double) count / 1000.0,
+				 max / 1000.0,
+				 last / 1000.0);
+		}
+
+		g_variant_iter_free (iter);
+		g_object_unref (reply);
+	}
+
+	if (do_stats) {
+		GVariant     *properties;
+		GVariantIter *iter;
+		const char   *name;
+		GVariant     *value;
+		GError       *error;
+
+		error = NULL;
+		properties = g_dbus_connection_call_sync (connection,
+							  GS_SERVICE,
+							  GS_PATH,
+							  "org.freedesktop.DBus.Properties",
+							  "GetAll",
+							  g_variant_new ("(s)", GS_STATS_INTERFACE),
+							  G_VARIANT_TYPE ("(a{sv})"),
+							  G_DBUS_CALL_FLAGS_NO_AUTO_START,
+							  -1,
+							  NULL,
+							  &error);
+		if (properties == NULL) {
+			g_message ("Could not read the screensaver's counters: %s", error->message);
+			g_error_free (error);
+			goto done;
+		}
+
+		g_variant_get (properties, "(a{sv})", &iter);
+
+		/* durations come in microseconds, the memory size in bytes */
+		while (g_variant_iter_loop (iter, "{&sv}", &name, &value)) {
+			if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT64)) {
+				g_print ("%-24s %8.1f ms\n", name, g_variant_get_int64 (value) / 1000.0);
+			} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT64)) {
+				char *size;
+
+				size = g_format_size (g_variant_get_uint64 (value));
+				g_print ("%-24s %8s\n", name, size);
+				g_free (size);
+			} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32)) {
+				g_print ("%-24s %8u\n", name, g_variant_get_uint32 (value));
+			}
+		}
+
+		g_variant_iter_free (iter);
+		g_variant_unref (properties);
+	}
+
 	if (do_lock) {
 		reply = screensaver_send_message_void (connection, "Lock", TRUE);
 		if (reply == NULL) {
@@ -38,11 +38,14 @@
 #include "gs-lock-plug.h"
 
 #include "gs-auth.h"
+#include "gs-backoff.h"
+#include "gs-secure-buffer.h"
 #include "setuid.h"
 
 #include "gs-debug.h"
 
 #define MAX_FAILURES 5
+#define SETCRED_TIMEOUT 30
 
 static gboolean verbose        = FALSE;
 static gboolean show_version   = FALSE;
@@ -51,6 +54,9 @@ static gboolean enable_switch  = FALSE;
 static char    *logout_command = NULL;
 static char    *status_message   = NULL;
 static char    *away_message     = NULL;
+static char    *auth_backend     = NULL;
+
+static GCancellable *auth_cancellable = NULL;
 
 static GOptionEntry entries [] = {
 	{ "verbose", 0, 0, G_OPTION_ARG_NONE, &verbose,
@@ -71,6 +77,18 @@ static GOptionEntry entries [] = {
 	  N_("Not used"),
 	  /* Translators: This is the example input for the --away-message command line option. */
 	  N_("MESSAGE") },
+	{ "auth-backend", 0, 0, G_OPTION_ARG_STRING, &auth_backend,
+	  N_("Authentication backend to use"),
+	  /* Translators: This is the example input for the --auth-backend command line option. */
+	  N_("NAME") },
+	{ NULL }
+};
+
+/* Looked at on its own before everything else, the backend has to be
+ * known before its privileged part runs */
+static GOptionEntry backend_entries [] = {
+	{ "auth-backend", 0, 0, G_OPTION_ARG_STRING, &auth_backend,
+	  NULL, NULL },
 	{ NULL }
 };
 
@@ -124,6 +142,13 @@ quit_response_ok (gpointer data)
 {
 	(void) data;
 
+	/* ask the daemon not to kill us while the credentials are
+	 * still being refreshed */
+	if (gs_auth_get_setcred_pending ()) {
+		printf ("NOTICE=SETCRED PENDING\n");
+		fflush (stdout);
+	}
+
 	response_ok ();
 	gtk_main_quit ();
 	return FALSE;
@@ -144,13 +169,14 @@ response_lock_init_failed (void)
 	response_ok ();
 }
 
-static char *
-request_response (GSLockPlug *plug,
-		  const char *prompt,
-		  gboolean    visible)
+static gboolean
+request_response (GSLockPlug     *plug,
+		  const char     *prompt,
+		  gboolean        visible,
+		  GSSecureBuffer *text)
 {
-	int   response;
-	char *text;
+	int      response;
+	gboolean ret;
 
 	gs_lock_plug_set_sensitive (plug, TRUE);
 	gs_lock_plug_enable_prompt (plug, prompt, visible);
@@ -158,13 +184,13 @@ request_response (GSLockPlug *plug,
 
 	gs_debug ("got response: %d", response);
 
-	text = NULL;
+	ret = FALSE;
 	if (response == GS_LOCK_PLUG_RESPONSE_OK) {
-		gs_lock_plug_get_text (plug, &text);
+		ret = gs_lock_plug_get_text (plug, text);
 	}
 	gs_lock_plug_disable_prompt (plug);
 
-	return text;
+	return ret;
 }
 
 /* Adapted from GDM2 daemon/verify-pam.c on 2006-06-13 */
@@ -215,41 +241,60 @@ maybe_translate_message (const char *msg)
 	}
 }
 
+static void
+interrupt_prompt_cb (GCancellable *cancellable,
+		     GSLockPlug   *plug)
+{
+	(void) cancellable;
+
+	gs_debug ("Prompt no longer needed");
+	gs_lock_plug_interrupt (plug);
+}
+
 static gboolean
 auth_message_handler (GSAuthMessageStyle style,
 		      const char        *msg,
-		      char             **response,
+		      GSSecureBuffer    *response,
+		      GCancellable      *cancellable,
 		      gpointer           data)
 {
 	gboolean    ret;
 	GSLockPlug *plug;
 	const char *message;
+	gulong      interrupt_id;
 
 	plug = GS_LOCK_PLUG (data);
 
+	if (g_cancellable_is_cancelled (cancellable)) {
+		return FALSE;
+	}
+
 	gs_profile_start (NULL);
 	gs_debug ("Got message style %d: '%s'", style, msg);
 
 	gtk_widget_show (GTK_WIDGET (plug));
 	gs_lock_plug_set_ready (plug);
 
-	ret = TRUE;
-	*response = NULL;
+	ret = FALSE;
 	message = maybe_translate_message (msg);
 
+	gs_lock_plug_trace_prompt (plug, gs_auth_get_message_time ());
+
+	/* another factor may get there first */
+	interrupt_id = g_cancellable_connect (cancellable,
+					      G_CALLBACK (interrupt_prompt_cb),
+					      plug,
+					      NULL);
+
 	switch (style) {
 	case GS_AUTH_MESSAGE_PROMPT_ECHO_ON:
 		if (msg != NULL) {
-			char *resp;
-			resp = request_response (plug, message, TRUE);
-			*response = resp;
+			ret = request_response (plug, message, TRUE, response);
 		}
 		break;
 	case GS_AUTH_MESSAGE_PROMPT_ECHO_OFF:
 		if (msg != NULL) {
-			char *resp;
-			resp = request_response (plug, message, FALSE);
-			*response = resp;
+			ret = request_response (plug, message, FALSE, response);
 		}
 		break;
 	case GS_AUTH_MESSAGE_ERROR_MSG:
@@ -262,9 +307,10 @@ auth_message_handler (GSAuthMessageStyle style,
 		g_assert_not_reached ();
 	}
 
-	if (*response == NULL) {
+	g_cancellable_disconnect (cancellable, interrupt_id);
+
+	if (! ret) {
 		gs_debug ("Got no response");
-		ret = FALSE;
 	} else {
 		gs_lock_plug_show_message (plug, _("Checking…"));
 		gs_lock_plug_set_sensitive (plug, FALSE);
@@ -281,15 +327,81 @@ auth_message_handler (GSAuthMessageStyle style,
 	return ret;
 }
 
+static gboolean auth_check_idle (GSLockPlug *plug);
+
+/* the wait after a failure is over */
 static gboolean
 reset_idle_cb (GSLockPlug *plug)
 {
+	if (g_cancellable_is_cancelled (auth_cancellable)) {
+		return FALSE;
+	}
+
 	gs_lock_plug_set_sensitive (plug, TRUE);
 	gs_lock_plug_show_message (plug, NULL);
 
+	g_idle_add ((GSourceFunc)auth_check_idle, plug);
+
 	return FALSE;
 }
 
+/* Tells the daemon where the time of an attempt went, it keeps the
+ * totals and adds how long it took to see our response.
+ */
+static void
+print_timeline (void)
+{
+	GSAuthTimeline timeline;
+
+	gs_auth_get_timeline (&timeline);
+
+	gs_debug ("Attempt timeline: setup %" G_GINT64_FORMAT " us, authenticate %" G_GINT64_FORMAT " us"
+		  " (%u prompts, %" G_GINT64_FORMAT " us in conversation, %" G_GINT64_FORMAT " us handing off),"
+		  " acct_mgmt %" G_GINT64_FORMAT " us, setcred %" G_GINT64_FORMAT " us",
+		  timeline.setup,
+		  timeline.authenticate,
+		  timeline.n_prompts,
+		  timeline.conversation,
+		  timeline.handoff,
+		  timeline.acct_mgmt,
+		  timeline.setcred);
+
+	printf ("TIMING=started:%" G_GINT64_FORMAT
+		" setup:%" G_GINT64_FORMAT
+		" authenticate:%" G_GINT64_FORMAT
+		" acct_mgmt:%" G_GINT64_FORMAT
+		" setcred:%" G_GINT64_FORMAT
+		" conversation:%" G_GINT64_FORMAT
+		" handoff:%" G_GINT64_FORMAT "\n",
+		timeline.started,
+		timeline.setup,
+		timeline.authenticate,
+		timeline.acct_mgmt,
+		timeline.setcred,
+		timeline.conversation,
+		timeline.handoff);
+	fflush (stdout);
+}
+
+/* the second factor got there while no attempt was running, in the
+ * wait before the next one or after the last one */
+static void
+second_factor_unlocked_cb (gpointer data)
+{
+	(void) data;
+
+	if (g_cancellable_is_cancelled (auth_cancellable)) {
+		return;
+	}
+
+	print_timeline ();
+	gs_backoff_reset ();
+
+	/* keeps a pending reset_idle_cb from starting another attempt */
+	g_cancellable_cancel (auth_cancellable);
+	quit_response_ok (NULL);
+}
+
 static gboolean
 do_auth_check (GSLockPlug *plug)
 {
@@ -300,9 +412,17 @@ do_auth_check (GSLockPlug *plug)
 
 	gs_lock_plug_disable_prompt (plug);
 	gs_lock_plug_set_busy (plug);
-	res = gs_auth_verify_user (g_get_user_name (), g_getenv ("DISPLAY"), auth_message_handler, plug, &error);
+	res = gs_auth_verify_user (g_get_user_name (), g_getenv ("DISPLAY"), auth_message_handler, plug, auth_cancellable, &error);
 
 	gs_debug ("Verify user returned: %s", res ? "TRUE" : "FALSE");
+	if (g_error_matches (error, GS_AUTH_ERROR, GS_AUTH_ERROR_CANCELLED)) {
+		/* we are on our way out, don't count it as a failure */
+		g_error_free (error);
+		return FALSE;
+	}
+
+	print_timeline ();
+
 	if (! res) {
 		if (error != NULL) {
 			gs_debug ("Verify user returned error: %s", error->message);
@@ -330,6 +450,8 @@ response_cb (GSLockPlug *plug,
 
 	if ((response_id == GS_LOCK_PLUG_RESPONSE_CANCEL) ||
 	    (response_id == GTK_RESPONSE_DELETE_EVENT)) {
+		/* abandons whatever the PAM stack is still doing */
+		g_cancellable_cancel (auth_cancellable);
 		quit_response_cancel ();
 	}
 }
@@ -356,25 +478,32 @@ quit_timeout_cb (gpointer data)
 static gboolean
 auth_check_idle (GSLockPlug *plug)
 {
-	gboolean     res;
-	gboolean     again;
-	static guint loop_counter = 0;
+	gboolean       res;
+	GSAuthTimeline timeline;
+	guint          delay;
+	static guint   loop_counter = 0;
 
-	again = TRUE;
 	res = do_auth_check (plug);
 
+	if (g_cancellable_is_cancelled (auth_cancellable)) {
+		return FALSE;
+	}
+
 	if (res) {
-		again = FALSE;
+		gs_backoff_reset ();
 		g_idle_add ((GSourceFunc)quit_response_ok, NULL);
 	} else {
 		loop_counter++;
 
+		/* the stack's own delay is left to us, see PAM_NO_DELAY */
+		gs_auth_get_timeline (&timeline);
+		delay = gs_backoff_failed (timeline.fail_delay / 1000);
+
 		if (loop_counter < MAX_FAILURES) {
-			gs_debug ("Authentication failed, retrying (%u)", loop_counter);
-			g_timeout_add_seconds (3, (GSourceFunc)reset_idle_cb, plug);
+			gs_debug ("Authentication failed, retrying (%u) in %u ms", loop_counter, delay);
+			g_timeout_add (delay, (GSourceFunc)reset_idle_cb, plug);
 		} else {
 			gs_debug ("Authentication failed, quitting (max failures)");
-			again = FALSE;
 			/* Don't quit immediately, but rather request that gnome-screensaver
 			 * terminates us after it has finished the dialog shake. Time out
 			 * after 5 seconds and quit anyway if this doesn't happen though */
@@ -383,7 +512,7 @@ auth_check_idle (GSLockPlug *plug)
 		}
 	}
 
-	return again;
+	return FALSE;
 }
 
 static void
@@ -395,12 +524,70 @@ show_cb (GtkWidget *widget,
 	print_id (widget);
 }
 
+/* The daemon writes whatever was typed before we were up to our stdin
+ * and then closes it, a trailing newline means it was ended with Return.
+ */
+static gboolean
+typeahead_watch (GIOChannel   *source,
+		 GIOCondition  condition,
+		 GSLockPlug   *plug)
+{
+	static GSSecureBuffer *typeahead = NULL;
+	const char            *data;
+	gsize                  len;
+	gboolean               submit;
+
+	if (typeahead == NULL) {
+		typeahead = gs_secure_buffer_new ();
+	}
+
+	if ((condition & G_IO_IN)
+	    && gs_secure_buffer_read (typeahead, g_io_channel_unix_get_fd (source)) > 0) {
+		return TRUE;
+	}
+
+	data = gs_secure_buffer_get_data (typeahead);
+	len = gs_secure_buffer_get_length (typeahead);
+
+	submit = (len > 0 && data[len - 1] == '\n');
+	if (submit) {
+		gs_secure_buffer_truncate (typeahead, len - 1);
+	}
+
+	gs_debug ("Got %" G_GSIZE_FORMAT " bytes of type-ahead", gs_secure_buffer_get_length (typeahead));
+	gs_lock_plug_set_typeahead (plug, data, submit);
+
+	gs_secure_buffer_free (typeahead);
+	typeahead = NULL;
+
+	return FALSE;
+}
+
+static void
+watch_typeahead (GSLockPlug *plug)
+{
+	GIOChannel *channel;
+
+	if (isatty (STDIN_FILENO)) {
+		return;
+	}
+
+	channel = g_io_channel_unix_new (STDIN_FILENO);
+	g_io_channel_set_close_on_unref (channel, TRUE);
+	g_io_add_watch (channel,
+			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+			(GIOFunc)typeahead_watch,
+			plug);
+	g_io_channel_unref (channel);
+}
+
 static gboolean
 popup_dialog_idle (gpointer data)
 {
 	(void) data;
 
 	GtkWidget *widget;
+	guint      delay;
 
 	gs_profile_start (NULL);
 
@@ -427,7 +614,28 @@ popup_dialog_idle (gpointer data)
 
 	gtk_widget_realize (widget);
 
-	g_idle_add ((GSourceFunc)auth_check_idle, widget);
+	watch_typeahead (GS_LOCK_PLUG (widget));
+
+	auth_cancellable = g_cancellable_new ();
+
+	/* a fingerprint reader, say, can unlock during the wait below */
+	gs_auth_start_second_factor (g_get_user_name (),
+				     g_getenv ("DISPLAY"),
+				     second_factor_unlocked_cb,
+				     NULL);
+
+	/* a dialog that was restarted still owes the rest of its wait */
+	gs_backoff_load ();
+	delay = gs_backoff_get_remaining ();
+	if (delay > 0) {
+		gs_debug ("Waiting %u ms before the first attempt", delay);
+		gtk_widget_show (widget);
+		gs_lock_plug_set_sensitive (GS_LOCK_PLUG (widget), FALSE);
+		gs_lock_plug_show_message (GS_LOCK_PLUG (widget), _("Too many failed attempts, please wait."));
+		g_timeout_add (delay, (GSourceFunc)reset_idle_cb, widget);
+	} else {
+		g_idle_add ((GSourceFunc)auth_check_idle, widget);
+	}
 
 	gs_profile_end (NULL);
 
@@ -435,6 +643,38 @@ popup_dialog_idle (gpointer data)
 }
 
 
+/* Everything else, --help included, is left for gtk_init_with_args() */
+static gboolean
+select_auth_backend (int    *argc,
+		     char ***argv)
+{
+	GOptionContext *context;
+	GError         *error;
+	gboolean        ret;
+
+	context = g_option_context_new (NULL);
+	g_option_context_set_help_enabled (context, FALSE);
+	g_option_context_set_ignore_unknown_options (context, TRUE);
+	g_option_context_add_main_entries (context, backend_entries, NULL);
+
+	error = NULL;
+	ret = g_option_context_parse (context, argc, argv, &error);
+	g_option_context_free (context);
+
+	if (! ret) {
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	if (auth_backend != NULL && ! gs_auth_set_backend (auth_backend)) {
+		fprintf (stderr, "Unknown authentication backend: %s\n", auth_backend);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 /*
  * Copyright (c) 1991-2004 Jamie Zawinski <jwz@jwz.org>
  * Copyright (c) 2005 William Jon McCann <mccann@jhu.edu>
@@ -581,6 +821,11 @@ main (int    argc,
 
 	gs_profile_start (NULL);
 
+	if (! select_auth_backend (&argc, &argv)) {
+		response_lock_init_failed ();
+		exit (1);
+	}
+
 	if (! privileged_initialization (&argc, argv, verbose)) {
 		response_lock_init_failed ();
 		exit (1);
@@ -611,10 +856,17 @@ main (int    argc,
 
 	gs_debug_init (verbose, FALSE);
 
+	/* have the user's passwd entry ready before the first attempt */
+	gs_auth_prewarm ();
+
 	g_idle_add ((GSourceFunc) popup_dialog_idle, NULL);
 
 	gtk_main ();
 
+	if (! gs_auth_wait_for_setcred (SETCRED_TIMEOUT)) {
+		g_warning ("Gave up waiting for the credentials to be refreshed");
+	}
+
 	gs_profile_end (NULL);
 	gs_debug_shutdown ();
 
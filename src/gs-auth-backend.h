@@ -0,0 +1,59 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_AUTH_BACKEND_H
+#define __GS_AUTH_BACKEND_H
+
+#include "gs-auth.h"
+
+G_BEGIN_DECLS
+
+/* What an authentication backend provides, gs-auth.c dispatches the
+ * public gs_auth_* calls to whichever one is selected.
+ */
+typedef struct {
+	const char* name;
+
+	gboolean (*priv_init)(void);
+	gboolean (*init)(void);
+	gboolean (*verify_user)(const char* username, const char* display, GSAuthMessageFunc func, gpointer data, GCancellable* cancellable, GError** error);
+	gint64 (*get_message_time)(void);
+	void (*get_timeline)(GSAuthTimeline* timeline);
+	gboolean (*get_setcred_pending)(void);
+	gboolean (*wait_for_setcred)(guint timeout_seconds);
+	/* NULL when there is no second factor */
+	void (*start_second_factor)(const char* username, const char* display, GSAuthUnlockFunc func, gpointer data);
+} GSAuthBackend;
+
+#ifdef WITH_BSD_AUTH
+extern const GSAuthBackend gs_auth_bsdauth_backend;
+#else
+extern const GSAuthBackend gs_auth_pam_backend;
+#endif
+
+/* Only linked into the tests and benchmarks, which install it with
+ * gs_auth_use_backend(); it is never in the table the dialog picks from */
+extern const GSAuthBackend gs_auth_mock_backend;
+
+void gs_auth_use_backend(const GSAuthBackend* impl);
+
+G_END_DECLS
+
+#endif /* __GS_AUTH_BACKEND_H */
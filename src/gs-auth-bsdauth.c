@@ -33,70 +33,121 @@
 #include <login_cap.h>
 #include <bsd_auth.h>
 
+#include <glib/gi18n.h>
+
 #include "gs-auth.h"
+#include "gs-auth-backend.h"
 #include "subprocs.h"
 
-static gboolean verbose_enabled = FALSE;
+static GSAuthTimeline  last_timeline;
+static GSSecureBuffer *password = NULL;
 
-GQuark
-gs_auth_error_quark (void)
+static gint64
+gs_auth_bsdauth_get_message_time (void)
 {
-	static GQuark quark = 0;
-	if (! quark) {
-		quark = g_quark_from_static_string ("gs_auth_error");
-	}
+	/* the prompt comes straight from us, there is no queue to time */
+	return 0;
+}
 
-	return quark;
+static void
+gs_auth_bsdauth_get_timeline (GSAuthTimeline *timeline)
+{
+	*timeline = last_timeline;
 }
 
-void
-gs_auth_set_verbose (gboolean enabled)
+static gboolean
+gs_auth_bsdauth_get_setcred_pending (void)
 {
-	verbose_enabled = enabled;
+	return FALSE;
 }
 
-gboolean
-gs_auth_get_verbose (void)
+static gboolean
+gs_auth_bsdauth_wait_for_setcred (guint timeout_seconds)
 {
-	return verbose_enabled;
+	(void) timeout_seconds;
+
+	return TRUE;
 }
 
-gboolean
-gs_auth_verify_user (const char       *username,
-		     const char       *display, 
-		     GSAuthMessageFunc func,
-		     gpointer          data,
-		     GError          **error)
+static gboolean
+gs_auth_bsdauth_verify_user (const char       *username,
+			     const char       *display,
+			     GSAuthMessageFunc func,
+			     gpointer          data,
+			     GCancellable     *cancellable,
+			     GError          **error)
 {
-	int res;
-	char *password;
+	int      res;
+	gboolean answered;
+
+	if (password == NULL) {
+		password = gs_secure_buffer_new ();
+	}
+
+	answered = FALSE;
+
+	memset (&last_timeline, 0, sizeof (last_timeline));
+	last_timeline.started = g_get_monotonic_time ();
 
 	/* ask for the password for user */
 	if (func != NULL) {
-		func (GS_AUTH_MESSAGE_PROMPT_ECHO_OFF,
-		    "Password: ",
-		    &password,
-		    data);
+		answered = func (GS_AUTH_MESSAGE_PROMPT_ECHO_OFF,
+				 "Password: ",
+				 password,
+				 cancellable,
+				 data);
+
+		last_timeline.conversation = g_get_monotonic_time () - last_timeline.started;
+		last_timeline.n_prompts = 1;
 	}
 
-	if (password == NULL) {
+	/* auth_userokay () does not block for long, so the only
+	 * place worth checking is after the prompt */
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_set_error (error,
+			     GS_AUTH_ERROR,
+			     GS_AUTH_ERROR_CANCELLED,
+			     "%s",
+			     _("Authentication was cancelled."));
+		gs_secure_buffer_clear (password);
+		return FALSE;
+	}
+
+	if (! answered) {
+		gs_secure_buffer_clear (password);
 		return FALSE;
 	}
 
 	/* authenticate */
-	res = auth_userokay((char *)username, NULL, "auth-budgie-screensaver", password);
+	res = auth_userokay((char *)username, NULL, "auth-budgie-screensaver",
+			    (char *) gs_secure_buffer_get_data (password));
+	gs_secure_buffer_clear (password);
+
+	last_timeline.authenticate = g_get_monotonic_time () - last_timeline.started;
 
 	return res;
 }
 
-gboolean
-gs_auth_init (void)
+static gboolean
+gs_auth_bsdauth_init (void)
 {
 	return TRUE;
 }
 
-gboolean
-gs_auth_priv_init (void)
+static gboolean
+gs_auth_bsdauth_priv_init (void)
 {
 	return TRUE;
 }
+
+const GSAuthBackend gs_auth_bsdauth_backend = {
+	"bsdauth",
+	gs_auth_bsdauth_priv_init,
+	gs_auth_bsdauth_init,
+	gs_auth_bsdauth_verify_user,
+	gs_auth_bsdauth_get_message_time,
+	gs_auth_bsdauth_get_timeline,
+	gs_auth_bsdauth_get_setcred_pending,
+	gs_auth_bsdauth_wait_for_setcred,
+	NULL,
+};
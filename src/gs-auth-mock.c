@@ -0,0 +1,355 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+#include "gs-auth.h"
+#include "gs-auth-backend.h"
+#include "gs-secure-buffer.h"
+
+/* An in-process backend for timing and exercising the unlock paths
+ * without a PAM stack.  It accepts whatever the environment tells it
+ * to, so it is only ever linked into the tests and benchmarks, never
+ * into the dialog.  It is set up with
+ *
+ *   GS_AUTH_MOCK_PASSWORD  the password to accept, "password" if unset
+ *   GS_AUTH_MOCK_LATENCY   milliseconds the stack takes once it has
+ *                          its answers, 0 if unset
+ *   GS_AUTH_MOCK_PROMPTS   the messages to send, as ';' separated
+ *                          style:text pairs where style is one of on,
+ *                          off, error or info; "off:Password:" if unset
+ *   GS_AUTH_MOCK_SECONDARY_LATENCY
+ *                          if set, a second factor succeeds this many
+ *                          milliseconds into each attempt, as a
+ *                          fingerprint reader would
+ *
+ * An attempt succeeds when every echo-off answer is the password, or
+ * when the second factor gets there first.
+ */
+
+typedef struct {
+	GMainLoop *loop;
+	guint      timeout_id;
+} MockWait;
+
+typedef struct {
+	GCancellable *cancellable;
+	gboolean      succeeded;
+} MockSecondary;
+
+static GSAuthTimeline  last_timeline;
+static gint64          message_time = 0;
+static GSSecureBuffer *response_buffer = NULL;
+
+static gboolean
+mock_wait_timeout_cb (MockWait *wait)
+{
+	wait->timeout_id = 0;
+	g_main_loop_quit (wait->loop);
+
+	return FALSE;
+}
+
+static void
+mock_wait_cancelled_cb (GCancellable *cancellable,
+			MockWait     *wait)
+{
+	(void) cancellable;
+
+	g_main_loop_quit (wait->loop);
+}
+
+/* keeps the gui running while the "stack" thinks */
+static void
+mock_wait (guint         msec,
+	   GCancellable *cancellable)
+{
+	MockWait wait;
+	gulong   cancelled_id;
+
+	if (msec == 0) {
+		return;
+	}
+
+	wait.loop = g_main_loop_new (NULL, FALSE);
+	wait.timeout_id = g_timeout_add (msec, (GSourceFunc) mock_wait_timeout_cb, &wait);
+
+	cancelled_id = g_cancellable_connect (cancellable,
+					      G_CALLBACK (mock_wait_cancelled_cb),
+					      &wait,
+					      NULL);
+
+	if (! g_cancellable_is_cancelled (cancellable)) {
+		g_main_loop_run (wait.loop);
+	}
+
+	g_cancellable_disconnect (cancellable, cancelled_id);
+
+	if (wait.timeout_id != 0) {
+		g_source_remove (wait.timeout_id);
+	}
+
+	g_main_loop_unref (wait.loop);
+}
+
+static void
+mock_chain_cancelled_cb (GCancellable *cancellable,
+			 GCancellable *chained)
+{
+	(void) cancellable;
+
+	g_cancellable_cancel (chained);
+}
+
+/* the second factor matched, whatever is being asked is moot */
+static gboolean
+mock_secondary_cb (MockSecondary *secondary)
+{
+	if (gs_auth_get_verbose ()) {
+		g_message ("Mock second factor succeeded");
+	}
+
+	secondary->succeeded = TRUE;
+	g_cancellable_cancel (secondary->cancellable);
+
+	return FALSE;
+}
+
+static gboolean
+parse_style (const char         *name,
+	     GSAuthMessageStyle *style)
+{
+	if (strcmp (name, "on") == 0) {
+		*style = GS_AUTH_MESSAGE_PROMPT_ECHO_ON;
+	} else if (strcmp (name, "off") == 0) {
+		*style = GS_AUTH_MESSAGE_PROMPT_ECHO_OFF;
+	} else if (strcmp (name, "error") == 0) {
+		*style = GS_AUTH_MESSAGE_ERROR_MSG;
+	} else if (strcmp (name, "info") == 0) {
+		*style = GS_AUTH_MESSAGE_TEXT_INFO;
+	} else {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gint64
+gs_auth_mock_get_message_time (void)
+{
+	return message_time;
+}
+
+static void
+gs_auth_mock_get_timeline (GSAuthTimeline *timeline)
+{
+	*timeline = last_timeline;
+}
+
+static gboolean
+gs_auth_mock_get_setcred_pending (void)
+{
+	return FALSE;
+}
+
+static gboolean
+gs_auth_mock_wait_for_setcred (guint timeout_seconds)
+{
+	(void) timeout_seconds;
+
+	return TRUE;
+}
+
+static gboolean
+gs_auth_mock_verify_user (const char       *username,
+			  const char       *display,
+			  GSAuthMessageFunc func,
+			  gpointer          data,
+			  GCancellable     *cancellable,
+			  GError          **error)
+{
+	(void) username;
+	(void) display;
+
+	const char   *password;
+	const char   *prompts;
+	const char   *latency;
+	const char   *secondary_latency;
+	char        **messages;
+	gboolean      ok;
+	gboolean      interrupted;
+	int           i;
+	MockSecondary secondary;
+	gulong        chained_id;
+	guint         secondary_id;
+
+	memset (&last_timeline, 0, sizeof (last_timeline));
+	last_timeline.started = g_get_monotonic_time ();
+
+	password = g_getenv ("GS_AUTH_MOCK_PASSWORD");
+	if (password == NULL) {
+		password = "password";
+	}
+
+	prompts = g_getenv ("GS_AUTH_MOCK_PROMPTS");
+	if (prompts == NULL) {
+		prompts = "off:Password:";
+	}
+
+	latency = g_getenv ("GS_AUTH_MOCK_LATENCY");
+	secondary_latency = g_getenv ("GS_AUTH_MOCK_SECONDARY_LATENCY");
+
+	/* the prompts are interrupted both when the caller gives up and
+	 * when the second factor wins */
+	secondary.cancellable = g_cancellable_new ();
+	secondary.succeeded = FALSE;
+	chained_id = g_cancellable_connect (cancellable,
+					    G_CALLBACK (mock_chain_cancelled_cb),
+					    secondary.cancellable,
+					    NULL);
+
+	secondary_id = 0;
+	if (secondary_latency != NULL) {
+		secondary_id = g_timeout_add (strtoul (secondary_latency, NULL, 10),
+					      (GSourceFunc) mock_secondary_cb,
+					      &secondary);
+	}
+
+	ok = TRUE;
+	interrupted = FALSE;
+	messages = g_strsplit (prompts, ";", -1);
+
+	for (i = 0; messages[i] != NULL && ! interrupted; i++) {
+		GSAuthMessageStyle style;
+		char              *text;
+		gboolean           res;
+
+		text = strchr (messages[i], ':');
+		if (text == NULL) {
+			g_warning ("Ignoring mock prompt without a style: %s", messages[i]);
+			continue;
+		}
+
+		*text++ = '\0';
+		if (! parse_style (messages[i], &style)) {
+			g_warning ("Ignoring mock prompt with unknown style: %s", messages[i]);
+			continue;
+		}
+
+		if (func == NULL) {
+			ok = FALSE;
+			break;
+		}
+
+		if (response_buffer == NULL) {
+			response_buffer = gs_secure_buffer_new ();
+		}
+
+		gs_secure_buffer_clear (response_buffer);
+		message_time = g_get_monotonic_time ();
+		res = func (style, text, response_buffer, secondary.cancellable, data);
+		last_timeline.conversation += g_get_monotonic_time () - message_time;
+		last_timeline.n_prompts++;
+		message_time = 0;
+
+		if (style == GS_AUTH_MESSAGE_PROMPT_ECHO_ON
+		    || style == GS_AUTH_MESSAGE_PROMPT_ECHO_OFF) {
+			/* as with PAM, a prompt left unanswered ends the conversation */
+			interrupted = res == FALSE || g_cancellable_is_cancelled (secondary.cancellable);
+		}
+
+		if (style == GS_AUTH_MESSAGE_PROMPT_ECHO_OFF
+		    && (res == FALSE
+			|| strcmp (gs_secure_buffer_get_data (response_buffer), password) != 0)) {
+			ok = FALSE;
+		}
+
+		gs_secure_buffer_clear (response_buffer);
+	}
+
+	g_strfreev (messages);
+
+	if (! interrupted && latency != NULL) {
+		mock_wait (strtoul (latency, NULL, 10), secondary.cancellable);
+	}
+
+	last_timeline.authenticate = g_get_monotonic_time () - last_timeline.started;
+
+	if (! secondary.succeeded && secondary_id != 0) {
+		g_source_remove (secondary_id);
+	}
+	g_cancellable_disconnect (cancellable, chained_id);
+	g_object_unref (secondary.cancellable);
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_set_error (error,
+			     GS_AUTH_ERROR,
+			     GS_AUTH_ERROR_CANCELLED,
+			     "%s",
+			     _("Authentication was cancelled."));
+		return FALSE;
+	}
+
+	if (secondary.succeeded) {
+		return TRUE;
+	}
+
+	if (interrupted || ! ok) {
+		g_set_error (error,
+			     GS_AUTH_ERROR,
+			     GS_AUTH_ERROR_AUTH_ERROR,
+			     "%s",
+			     _("Incorrect password."));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+gs_auth_mock_init (void)
+{
+	return TRUE;
+}
+
+static gboolean
+gs_auth_mock_priv_init (void)
+{
+	return TRUE;
+}
+
+const GSAuthBackend gs_auth_mock_backend = {
+	"mock",
+	gs_auth_mock_priv_init,
+	gs_auth_mock_init,
+	gs_auth_mock_verify_user,
+	gs_auth_mock_get_message_time,
+	gs_auth_mock_get_timeline,
+	gs_auth_mock_get_setcred_pending,
+	gs_auth_mock_wait_for_setcred,
+	NULL,
+};
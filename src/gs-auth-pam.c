@@ -37,13 +37,18 @@
 #include <security/pam_ext.h>
 #include <signal.h>
 #include <errno.h>
+#include <unistd.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
-#include <gtk/gtk.h>
+#include <gio/gio.h>
 
 #include "gs-auth.h"
+#include "gs-auth-backend.h"
 
 #include "subprocs.h"
 
@@ -64,51 +69,114 @@
 
 # define PAM_STRERROR(pamh, status) pam_strerror((pamh), (status))
 
-static gboolean      verbose_enabled = FALSE;
-static pam_handle_t *pam_handle = NULL;
-static gboolean      did_we_ask_for_password = FALSE;
+/* A thread running one PAM service.  The password service always has
+ * one; a second service, such as a fingerprint reader, gets its own
+ * when SECONDARY_PAM_SERVICE is set so that both can wait at the same
+ * time.  The handle and what it was opened for are kept across
+ * attempts for as long as these don't change, only the worker touches
+ * them.
+ */
+typedef struct {
+	const char   *service;
+	GAsyncQueue  *queue;
+	GThread      *thread;
+
+	pam_handle_t *handle;
+	char         *handle_username;
+	char         *handle_display;
+} GSAuthWorker;
+
+/* One authentication attempt.  The dialog (main) thread creates it and
+ * queues it to the worker, the worker runs the PAM stack for it and
+ * hands it back through an idle.  Both sides hold a reference, so a
+ * cancelled request can be dropped by the main thread while the worker
+ * is still stuck in a module.
+ */
+typedef struct _GSAuthRequest GSAuthRequest;
+
+struct _GSAuthRequest {
+	gint              ref_count;
+	gint              cancelled;
+
+	GSAuthWorker     *worker;
+	gboolean          secondary;
+	GCancellable     *cancellable;
 
-struct pam_closure {
-	const char       *username;
+	char             *username;
+	char             *display;
 	GSAuthMessageFunc cb_func;
 	gpointer          cb_data;
-	int               signal_fd;
-	int               result;
+
+	/* only touched by the worker, except for timeline.handoff
+	 * which the gui adds to while it holds a prompt */
+	gboolean          did_we_ask_for_password;
+	int               status;
+	GSAuthTimeline    timeline;
+
+	/* the prompt being passed to the gui, the worker fills these in
+	 * before posting the request to the mailbox and doesn't look at
+	 * them again until message_state is GS_AUTH_MESSAGE_HANDLED */
+	GSAuthMessageStyle message_style;
+	const char       *message;
+	GSSecureBuffer   *message_response;
+	gint64            message_time;
+	gboolean          message_interrupt;
+	gint              message_state;
+
+	/* only touched by the main thread */
+	GMainLoop        *loop;
+	gboolean          done;
+	GSAuthRequest    *sibling;
 };
 
-typedef struct {
-	struct pam_closure *closure;
-	GSAuthMessageStyle style;
-	const char        *msg;
-	char             **resp;
-	gboolean           should_interrupt_stack;
-} GsAuthMessageHandlerData;
+typedef enum {
+	GS_AUTH_MESSAGE_QUEUED,
+	GS_AUTH_MESSAGE_RUNNING,
+	GS_AUTH_MESSAGE_HANDLED
+} GSAuthMessageState;
+
+/* There is only ever one prompt in flight, so the handoff between the
+ * worker and the gui is a single slot.  The worker posts its request
+ * and kicks notify_fds, which the main loop watches; the gui answers
+ * through the request's message_state and kicks reply_fds, which the
+ * worker blocks on.  A wakeup is an eventfd where there is one and a
+ * pipe otherwise, [0] is the end to read.
+ */
+static GSAuthRequest *mailbox = NULL;
+static int            notify_fds[2] = { -1, -1 };
+static int            reply_fds[2] = { -1, -1 };
+static gint64         message_time = 0;
+
+/* Where the gui puts its answer.  It is allocated once and wiped after
+ * every prompt; the only other copy of a password is the one PAM asks
+ * for in the reply, which it wipes itself.
+ */
+static GSSecureBuffer *response_buffer = NULL;
 
-static GCond message_handled_condition;
-static GMutex message_handler_mutex;
+static GSAuthTimeline last_timeline;
 
-GQuark
-gs_auth_error_quark (void)
-{
-	static GQuark quark = 0;
-	if (! quark) {
-		quark = g_quark_from_static_string ("gs_auth_error");
-	}
+/* set while the worker is still refreshing credentials after having
+ * reported a success, see WITH_DEFERRED_SETCRED */
+static GMutex   setcred_mutex;
+static GCond    setcred_condition;
+static gboolean setcred_pending = FALSE;
 
-	return quark;
-}
+static GSAuthWorker password_worker = { PAM_SERVICE_NAME, NULL, NULL, NULL, NULL, NULL };
+#ifdef SECONDARY_PAM_SERVICE
+static GSAuthWorker secondary_worker = { SECONDARY_PAM_SERVICE, NULL, NULL, NULL, NULL, NULL };
 
-void
-gs_auth_set_verbose (gboolean enabled)
-{
-	verbose_enabled = enabled;
-}
+/* The second factor keeps waiting between password attempts, so it is
+ * held on to until it either finishes or the dialog gives up.  Only
+ * touched by the main thread.
+ */
+static GSAuthRequest *secondary_request = NULL;
 
-gboolean
-gs_auth_get_verbose (void)
-{
-	return verbose_enabled;
-}
+/* what to tell when it succeeds with no attempt running */
+static GSAuthUnlockFunc secondary_unlock_func = NULL;
+static gpointer         secondary_unlock_data = NULL;
+
+static void gs_auth_drop_secondary (void);
+#endif
 
 static GSAuthMessageStyle
 pam_style_to_gs_style (int pam_style)
@@ -136,25 +204,67 @@ pam_style_to_gs_style (int pam_style)
 	return style;
 }
 
+static GSAuthRequest *
+gs_auth_request_new (GSAuthWorker     *worker,
+		     const char       *username,
+		     const char       *display,
+		     GSAuthMessageFunc func,
+		     gpointer          data)
+{
+	GSAuthRequest *request;
+
+	request = g_new0 (GSAuthRequest, 1);
+	request->ref_count = 1;
+	request->worker = worker;
+	request->secondary = (worker != &password_worker);
+	request->cancellable = g_cancellable_new ();
+	request->username = g_strdup (username);
+	request->display = g_strdup (display);
+	request->cb_func = func;
+	request->cb_data = data;
+	request->status = PAM_AUTH_ERR;
+	request->message_state = GS_AUTH_MESSAGE_HANDLED;
+
+	return request;
+}
+
+static GSAuthRequest *
+gs_auth_request_ref (GSAuthRequest *request)
+{
+	g_atomic_int_inc (&request->ref_count);
+
+	return request;
+}
+
+static void
+gs_auth_request_unref (GSAuthRequest *request)
+{
+	if (! g_atomic_int_dec_and_test (&request->ref_count)) {
+		return;
+	}
+
+	g_object_unref (request->cancellable);
+	g_free (request->username);
+	g_free (request->display);
+	g_free (request);
+}
+
 static gboolean
 auth_message_handler (GSAuthMessageStyle style,
 		      const char        *msg,
-		      char             **response,
 		      gpointer           data)
 {
-	(void) data;
-
-	gboolean ret;
+	GSAuthRequest *request = data;
+	gboolean       ret;
 
 	ret = TRUE;
-	*response = NULL;
 
 	switch (style) {
 	case GS_AUTH_MESSAGE_PROMPT_ECHO_ON:
 		break;
 	case GS_AUTH_MESSAGE_PROMPT_ECHO_OFF:
 		if (msg != NULL && g_str_has_prefix (msg, _("Password:"))) {
-			did_we_ask_for_password = TRUE;
+			request->did_we_ask_for_password = TRUE;
 		}
 		break;
 	case GS_AUTH_MESSAGE_ERROR_MSG:
@@ -169,72 +279,175 @@ auth_message_handler (GSAuthMessageStyle style,
 }
 
 static gboolean
-gs_auth_queued_message_handler (GsAuthMessageHandlerData *data)
+wakeup_open (int fds[2])
 {
-	gboolean res;
+#ifdef HAVE_EVENTFD
+	fds[0] = fds[1] = eventfd (0, EFD_CLOEXEC);
 
-	if (gs_auth_get_verbose ()) {
-		g_message ("Waiting for lock");
+	return fds[0] >= 0;
+#else
+	if (pipe (fds) < 0) {
+		return FALSE;
 	}
 
-	g_mutex_lock (&message_handler_mutex);
+	fcntl (fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl (fds[1], F_SETFD, FD_CLOEXEC);
+
+	return TRUE;
+#endif
+}
+
+static void
+wakeup_close (int fds[2])
+{
+	if (fds[1] >= 0 && fds[1] != fds[0]) {
+		close (fds[1]);
+	}
+
+	if (fds[0] >= 0) {
+		close (fds[0]);
+	}
+
+	fds[0] = fds[1] = -1;
+}
+
+/* eventfd wants exactly eight bytes, a pipe doesn't mind */
+static void
+wakeup_signal (int fds[2])
+{
+	guint64 one = 1;
+
+	while (write (fds[1], &one, sizeof (one)) < 0 && errno == EINTR) {
+		;
+	}
+}
+
+static void
+wakeup_wait (int fds[2])
+{
+	guint64 count;
+
+	while (read (fds[0], &count, sizeof (count)) < 0 && errno == EINTR) {
+		;
+	}
+}
+
+static void
+gs_auth_finish_message (GSAuthRequest *request,
+			gboolean       interrupt)
+{
+	request->message_interrupt = interrupt;
+	g_atomic_int_set (&request->message_state, GS_AUTH_MESSAGE_HANDLED);
+	wakeup_signal (reply_fds);
+}
+
+static gboolean
+gs_auth_mailbox_cb (GIOChannel  *source,
+		    GIOCondition condition,
+		    gpointer     data)
+{
+	(void) source;
+	(void) condition;
+	(void) data;
+
+	GSAuthRequest *request;
+	gboolean       res;
+
+	wakeup_wait (notify_fds);
+
+	/* the request can only be freed from this thread, so it is
+	 * safe to look at for as long as we are here */
+	request = g_atomic_pointer_get (&mailbox);
+	if (request == NULL
+	    || ! g_atomic_int_compare_and_exchange (&request->message_state,
+						    GS_AUTH_MESSAGE_QUEUED,
+						    GS_AUTH_MESSAGE_RUNNING)) {
+		return TRUE;
+	}
+
+	if (g_atomic_int_get (&request->cancelled)) {
+		gs_auth_finish_message (request, TRUE);
+		return TRUE;
+	}
 
 	if (gs_auth_get_verbose ()) {
 		g_message ("Waiting for response");
 	}
 
-	res = data->closure->cb_func (data->style,
-				      data->msg,
-				      data->resp,
-				      data->closure->cb_data);
+	message_time = request->message_time;
+	request->timeline.handoff += g_get_monotonic_time () - message_time;
 
-	data->should_interrupt_stack = res == FALSE;
+	res = request->cb_func (request->message_style,
+				request->message,
+				request->message_response,
+				request->cancellable,
+				request->cb_data);
+	message_time = 0;
 
-	g_cond_signal (&message_handled_condition);
-	g_mutex_unlock (&message_handler_mutex);
+	gs_auth_finish_message (request, res == FALSE || g_atomic_int_get (&request->cancelled));
 
 	if (gs_auth_get_verbose ()) {
 		g_message ("Got response");
 	}
 
-	return FALSE;
+	return TRUE;
 }
 
-static gboolean
-gs_auth_run_message_handler (struct pam_closure *c,
-			     GSAuthMessageStyle  style,
-			     const char         *msg,
-			     char              **resp)
+static gint64
+gs_auth_pam_get_message_time (void)
 {
-	GsAuthMessageHandlerData data;
+	return message_time;
+}
 
-	data.closure = c;
-	data.style = style;
-	data.msg = msg;
-	data.resp = resp;
-	data.should_interrupt_stack = TRUE;
+static void
+gs_auth_pam_get_timeline (GSAuthTimeline *timeline)
+{
+	*timeline = last_timeline;
+}
 
-	g_mutex_lock (&message_handler_mutex);
+static gboolean
+gs_auth_run_message_handler (GSAuthRequest     *request,
+			     GSAuthMessageStyle style,
+			     const char        *msg,
+			     GSSecureBuffer    *resp,
+			     gint64             received)
+{
+	if (g_atomic_int_get (&request->cancelled)) {
+		return FALSE;
+	}
+
+	request->message_style = style;
+	request->message = msg;
+	request->message_response = resp;
+	request->message_time = received;
+	request->message_interrupt = TRUE;
+	g_atomic_int_set (&request->message_state, GS_AUTH_MESSAGE_QUEUED);
 
-	/* Queue the callback in the gui (the main) thread
+	/* Hand the callback to the gui (the main) thread
 	 */
-	g_idle_add ((GSourceFunc) gs_auth_queued_message_handler, &data);
+	g_atomic_pointer_set (&mailbox, request);
+	wakeup_signal (notify_fds);
 
 	if (gs_auth_get_verbose ()) {
 		g_message ("Waiting for respose to message style %d: '%s'", style, msg);
 	}
 
-	/* Wait for the response
+	/* Wait for the response, or for the request to be cancelled
 	 */
-	g_cond_wait (&message_handled_condition,
-		     &message_handler_mutex);
-	g_mutex_unlock (&message_handler_mutex);
+	while (g_atomic_int_get (&request->message_state) != GS_AUTH_MESSAGE_HANDLED) {
+		wakeup_wait (reply_fds);
+	}
+
+	g_atomic_pointer_set (&mailbox, NULL);
+
+	request->timeline.conversation += g_get_monotonic_time () - received;
+	request->timeline.n_prompts++;
 
 	if (gs_auth_get_verbose ()) {
-		g_message ("Got respose to message style %d: interrupt:%d", style, data.should_interrupt_stack);
+		g_message ("Got respose to message style %d: interrupt:%d", style, request->message_interrupt);
 	}
 
-	return data.should_interrupt_stack == FALSE;
+	return request->message_interrupt == FALSE;
 }
 
 static int
@@ -245,9 +458,12 @@ pam_conversation (int                        nmsgs,
 {
 	int                  replies = 0;
 	struct pam_response *reply = NULL;
-	struct pam_closure  *c = (struct pam_closure *) closure;
+	GSAuthRequest       *request = (GSAuthRequest *) closure;
 	gboolean             res;
 	int                  ret;
+	gint64               received;
+
+	received = g_get_monotonic_time ();
 
 	reply = (struct pam_response *) calloc (nmsgs, sizeof (*reply));
 
@@ -288,20 +504,22 @@ pam_conversation (int                        nmsgs,
 		/* handle message locally first */
 		auth_message_handler (style,
 				      utf8_msg,
-				      &reply [replies].resp,
-				      NULL);
+				      request);
 
-		if (c->cb_func != NULL) {
+		if (request->cb_func != NULL) {
 			if (gs_auth_get_verbose ()) {
 				g_message ("Handling message style %d: '%s'", style, utf8_msg);
 			}
 
-			/* blocks until the gui responds
+			/* blocks until the gui responds or the request
+			 * is cancelled
 			 */
-			res = gs_auth_run_message_handler (c,
+			gs_secure_buffer_clear (response_buffer);
+			res = gs_auth_run_message_handler (request,
 							   style,
 							   utf8_msg,
-							   &reply [replies].resp);
+							   response_buffer,
+							   received);
 
 			if (gs_auth_get_verbose ()) {
 				g_message ("Msg handler returned %d", res);
@@ -309,10 +527,20 @@ pam_conversation (int                        nmsgs,
 
 			/* If the handler returns FALSE - interrupt the PAM stack */
 			if (res) {
+				/* PAM frees the reply, so this one copy has
+				 * to come from malloc */
+				if (style == GS_AUTH_MESSAGE_PROMPT_ECHO_ON
+				    || style == GS_AUTH_MESSAGE_PROMPT_ECHO_OFF) {
+					reply [replies].resp = strndup (gs_secure_buffer_get_data (response_buffer),
+									gs_secure_buffer_get_length (response_buffer));
+				}
 				reply [replies].resp_retcode = PAM_SUCCESS;
 			} else {
 				int i;
 				for (i = 0; i <= replies; i++) {
+					if (reply [i].resp != NULL) {
+						gs_secure_zero (reply [i].resp, strlen (reply [i].resp));
+					}
 					free (reply [i].resp);
 				}
 				free (reply);
@@ -321,6 +549,7 @@ pam_conversation (int                        nmsgs,
 			}
 		}
 
+		gs_secure_buffer_clear (response_buffer);
 		g_free (utf8_msg);
 	}
 
@@ -329,15 +558,89 @@ pam_conversation (int                        nmsgs,
 	return ret;
 }
 
+/* The second service runs without a gui of its own: there is nobody
+ * to answer a prompt, and its messages ("Place your finger on the
+ * reader") would fight with the password prompt over the one label,
+ * so they only end up in the log.
+ */
+static int
+secondary_conversation (int                        nmsgs,
+			const struct pam_message **msg,
+			struct pam_response      **resp,
+			void                      *closure)
+{
+	struct pam_response *reply;
+	GSAuthRequest       *request = (GSAuthRequest *) closure;
+	int                  i;
+
+	if (g_atomic_int_get (&request->cancelled)) {
+		return PAM_CONV_ERR;
+	}
+
+	for (i = 0; i < nmsgs; i++) {
+		if (msg [i]->msg_style == PAM_PROMPT_ECHO_ON
+		    || msg [i]->msg_style == PAM_PROMPT_ECHO_OFF) {
+			if (gs_auth_get_verbose ()) {
+				g_message ("%s: can't answer prompt '%s'",
+					   request->worker->service,
+					   msg [i]->msg);
+			}
+
+			return PAM_CONV_ERR;
+		}
+	}
+
+	reply = (struct pam_response *) calloc (nmsgs, sizeof (*reply));
+	if (reply == NULL) {
+		return PAM_CONV_ERR;
+	}
+
+	for (i = 0; i < nmsgs; i++) {
+		if (gs_auth_get_verbose ()) {
+			g_message ("%s: %s", request->worker->service, msg [i]->msg);
+		}
+
+		reply [i].resp_retcode = PAM_SUCCESS;
+	}
+
+	*resp = reply;
+
+	return PAM_SUCCESS;
+}
+
+#ifdef PAM_FAIL_DELAY
+/* Instead of sleeping in the worker, the delay the modules asked for
+ * after a failure is passed on to the dialog, which waits it out
+ * together with its own backoff.
+ */
+static void
+pam_fail_delay_cb (int           retval,
+		   unsigned int  usec_delay,
+		   void         *appdata_ptr)
+{
+	GSAuthRequest *request = appdata_ptr;
+
+	if (retval != PAM_SUCCESS) {
+		request->timeline.fail_delay = usec_delay;
+	}
+}
+#endif
+
 static gboolean
-close_pam_handle (int status)
+close_pam_handle (GSAuthWorker *worker,
+		  int           status)
 {
 
-	if (pam_handle != NULL) {
+	if (worker->handle != NULL) {
 		int status2;
 
-		status2 = pam_end (pam_handle, status);
-		pam_handle = NULL;
+		status2 = pam_end (worker->handle, status);
+		worker->handle = NULL;
+
+		g_free (worker->handle_username);
+		worker->handle_username = NULL;
+		g_free (worker->handle_display);
+		worker->handle_display = NULL;
 
 		if (gs_auth_get_verbose ()) {
 			g_message (" pam_end (...) ==> %d (%s)",
@@ -346,37 +649,35 @@ close_pam_handle (int status)
 		}
 	}
 
-	g_cond_clear (&message_handled_condition);
-	g_mutex_clear (&message_handler_mutex);
-
 	return TRUE;
 }
 
 static gboolean
-create_pam_handle (const char      *username,
+create_pam_handle (GSAuthWorker    *worker,
+		   const char      *username,
 		   const char      *display,
 		   struct pam_conv *conv,
 		   int             *status_code)
 {
 	int         status;
-	const char *service = PAM_SERVICE_NAME;
+	const char *service = worker->service;
 	char       *disp;
 	gboolean    ret;
 
-	if (pam_handle != NULL) {
+	if (worker->handle != NULL) {
 		g_warning ("create_pam_handle: Stale pam handle around, cleaning up");
-		close_pam_handle (PAM_SUCCESS);
+		close_pam_handle (worker, PAM_SUCCESS);
 	}
 
 	/* init things */
-	pam_handle = NULL;
+	worker->handle = NULL;
 	status = -1;
 	disp = NULL;
 	ret = TRUE;
 
 	/* Initialize a PAM session for the user */
-	if ((status = pam_start (service, username, conv, &pam_handle)) != PAM_SUCCESS) {
-		pam_handle = NULL;
+	if ((status = pam_start (service, username, conv, &worker->handle)) != PAM_SUCCESS) {
+		worker->handle = NULL;
 		g_warning (_("Unable to establish service %s: %s\n"),
 			   service,
 			   PAM_STRERROR (NULL, status));
@@ -394,7 +695,7 @@ create_pam_handle (const char      *username,
 			   service,
 			   username,
 			   status,
-			   PAM_STRERROR (pam_handle, status));
+			   PAM_STRERROR (worker->handle, status));
 	}
 
 	disp = g_strdup (display);
@@ -402,7 +703,7 @@ create_pam_handle (const char      *username,
 		disp = g_strdup (":0.0");
 	}
 
-	if ((status = pam_set_item (pam_handle, PAM_TTY, disp)) != PAM_SUCCESS) {
+	if ((status = pam_set_item (worker->handle, PAM_TTY, disp)) != PAM_SUCCESS) {
 		g_warning (_("Can't set PAM_TTY=%s"), display);
 
 		if (status_code != NULL) {
@@ -426,8 +727,9 @@ create_pam_handle (const char      *username,
 }
 
 static void
-set_pam_error (GError **error,
-	       int      status)
+set_pam_error (GError  **error,
+	       int       status,
+	       gboolean  did_we_ask_for_password)
 {
 	if (status == PAM_AUTH_ERR || status == PAM_USER_UNKNOWN) {
 		char *msg;
@@ -460,8 +762,38 @@ set_pam_error (GError **error,
 
 }
 
-static void*
-gs_auth_thread_func (void* auth_operation_fd)
+static int
+refresh_credentials (pam_handle_t   *handle,
+		     GSAuthTimeline *timeline)
+{
+	int    status;
+	gint64 start;
+
+	/* Each time we successfully authenticate, refresh credentials,
+	   for Kerberos/AFS/DCE/etc.  If this fails, just ignore that
+	   failure and blunder along; it shouldn't matter.
+
+	   Note: this used to be PAM_REFRESH_CRED instead of
+	   PAM_REINITIALIZE_CRED, but Jason Heiss <jheiss@ee.washington.edu>
+	   says that the Linux PAM library ignores that one, and only refreshes
+	   credentials when using PAM_REINITIALIZE_CRED.
+	*/
+	start = g_get_monotonic_time ();
+	status = pam_setcred (handle, PAM_REINITIALIZE_CRED);
+	timeline->setcred = g_get_monotonic_time () - start;
+	if (gs_auth_get_verbose ()) {
+		g_message ("   pam_setcred (...) ==> %d (%s) in %" G_GINT64_FORMAT " us",
+			   status,
+			   PAM_STRERROR (handle, status),
+			   timeline->setcred);
+	}
+
+	return status;
+}
+
+static int
+run_pam_stack (pam_handle_t   *handle,
+	       GSAuthTimeline *timeline)
 {
 	static const int flags = 0;
 	int              status;
@@ -469,13 +801,16 @@ gs_auth_thread_func (void* auth_operation_fd)
 	struct timespec  timeout;
 	sigset_t         set;
 	const void      *p;
+	gint64           start;
 
 	timeout.tv_sec = 0;
 	timeout.tv_nsec = 1;
 
 	set = block_sigchld ();
 
-	status = pam_authenticate (pam_handle, flags);
+	start = g_get_monotonic_time ();
+	status = pam_authenticate (handle, flags);
+	timeline->authenticate = g_get_monotonic_time () - start;
 
 	sigtimedwait (&set, NULL, &timeout);
 	unblock_sigchld ();
@@ -483,14 +818,14 @@ gs_auth_thread_func (void* auth_operation_fd)
 	if (gs_auth_get_verbose ()) {
 		g_message ("   pam_authenticate (...) ==> %d (%s)",
 			   status,
-			   PAM_STRERROR (pam_handle, status));
+			   PAM_STRERROR (handle, status));
 	}
 
 	if (status != PAM_SUCCESS) {
 		goto done;
 	}
 
-	if ((status = pam_get_item (pam_handle, PAM_USER, &p)) != PAM_SUCCESS) {
+	if ((status = pam_get_item (handle, PAM_USER, &p)) != PAM_SUCCESS) {
 		/* is not really an auth problem, but it will
 		   pretty much look as such, it shouldn't really
 		   happen */
@@ -501,12 +836,14 @@ gs_auth_thread_func (void* auth_operation_fd)
 	 * but we need to run them anyway because certain pam modules
 	 * depend on side effects of the account modules getting run.
 	 */
-	status2 = pam_acct_mgmt (pam_handle, 0);
+	start = g_get_monotonic_time ();
+	status2 = pam_acct_mgmt (handle, 0);
+	timeline->acct_mgmt = g_get_monotonic_time () - start;
 
 	if (gs_auth_get_verbose ()) {
 		g_message ("pam_acct_mgmt (...) ==> %d (%s)\n",
 			   status2,
-			   PAM_STRERROR (pam_handle, status2));
+			   PAM_STRERROR (handle, status2));
 	}
 
 	/* FIXME: should we handle these? */
@@ -514,12 +851,12 @@ gs_auth_thread_func (void* auth_operation_fd)
 	case PAM_SUCCESS:
 		break;
 	case PAM_NEW_AUTHTOK_REQD:
-		status2 = pam_chauthtok (pam_handle, PAM_CHANGE_EXPIRED_AUTHTOK);
+		status2 = pam_chauthtok (handle, PAM_CHANGE_EXPIRED_AUTHTOK);
 
 		if (status2 != PAM_SUCCESS) {
 		    g_message ("pam_acct_mgmt (...) ==> %d (%s)\n",
 			   status2,
-			   PAM_STRERROR (pam_handle, status2));
+			   PAM_STRERROR (handle, status2));
 		    status = status2;
 		}
 		break;
@@ -533,188 +870,555 @@ gs_auth_thread_func (void* auth_operation_fd)
 		break;
 	}
 
-	/* Each time we successfully authenticate, refresh credentials,
-	   for Kerberos/AFS/DCE/etc.  If this fails, just ignore that
-	   failure and blunder along; it shouldn't matter.
+#ifndef WITH_DEFERRED_SETCRED
+	refresh_credentials (handle, timeline);
+#endif
+
+ done:
+	return status;
+}
+
+static gboolean
+reuse_pam_handle (GSAuthRequest   *request,
+		  struct pam_conv *conv)
+{
+	GSAuthWorker *worker = request->worker;
+	int           status;
+
+	if (worker->handle == NULL) {
+		return FALSE;
+	}
+
+	if (g_strcmp0 (worker->handle_username, request->username) != 0
+	    || g_strcmp0 (worker->handle_display, request->display) != 0) {
+		close_pam_handle (worker, PAM_SUCCESS);
+		return FALSE;
+	}
+
+	/* The conversation data is the request, which is new every time.
+	 * Modules may also map the name they were given to another one, so
+	 * start each attempt from the user we were asked about again.  The
+	 * library itself drops PAM_AUTHTOK once pam_authenticate() returns.
+	 */
+	status = pam_set_item (worker->handle, PAM_CONV, conv);
+	if (status == PAM_SUCCESS) {
+		status = pam_set_item (worker->handle, PAM_USER, request->username);
+	}
+
+	if (status != PAM_SUCCESS) {
+		g_warning ("Unable to reuse the PAM handle: %s", PAM_STRERROR (worker->handle, status));
+		close_pam_handle (worker, status);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int
+gs_auth_worker_run (GSAuthRequest *request)
+{
+	GSAuthWorker   *worker = request->worker;
+	int             status = -1;
+	struct pam_conv conv;
+	gint64          start;
+	gboolean        reused;
+
+	if (request->secondary) {
+		conv.conv = &secondary_conversation;
+	} else {
+		conv.conv = &pam_conversation;
+	}
+	conv.appdata_ptr = (void *) request;
+
+	start = g_get_monotonic_time ();
+
+	reused = reuse_pam_handle (request, &conv);
+	if (! reused) {
+		/* Initialize PAM. */
+		create_pam_handle (worker, request->username, request->display, &conv, &status);
+		if (status != PAM_SUCCESS) {
+			goto done;
+		}
+
+		pam_set_item (worker->handle, PAM_USER_PROMPT, _("Username:"));
+
+		worker->handle_username = g_strdup (request->username);
+		worker->handle_display = g_strdup (request->display);
+	}
+
+	PAM_NO_DELAY(worker->handle);
+#ifdef PAM_FAIL_DELAY
+	pam_set_item (worker->handle, PAM_FAIL_DELAY, (const void *) pam_fail_delay_cb);
+#endif
+
+	request->timeline.setup = g_get_monotonic_time () - start;
 
-	   Note: this used to be PAM_REFRESH_CRED instead of
-	   PAM_REINITIALIZE_CRED, but Jason Heiss <jheiss@ee.washington.edu>
-	   says that the Linux PAM library ignores that one, and only refreshes
-	   credentials when using PAM_REINITIALIZE_CRED.
-	*/
-	status2 = pam_setcred (pam_handle, PAM_REINITIALIZE_CRED);
 	if (gs_auth_get_verbose ()) {
-		g_message ("   pam_setcred (...) ==> %d (%s)",
-			   status2,
-			   PAM_STRERROR (pam_handle, status2));
+		g_message ("%s %s PAM handle in %" G_GINT64_FORMAT " us",
+			   reused ? "Reused" : "Opened",
+			   worker->service,
+			   request->timeline.setup);
 	}
 
+	request->did_we_ask_for_password = FALSE;
+	status = run_pam_stack (worker->handle, &request->timeline);
+
+	/* Only a failed attempt is followed by another one; after a
+	 * success the dialog goes away, and PAM_ABORT means the stack
+	 * can't go on with this handle.
+	 */
+	if (status != PAM_SUCCESS && status != PAM_ABORT) {
+		return status;
+	}
+
+#ifdef WITH_DEFERRED_SETCRED
+	/* the worker refreshes the credentials and closes the
+	 * handle once the success has been reported */
+	if (status == PAM_SUCCESS) {
+		g_mutex_lock (&setcred_mutex);
+		setcred_pending = TRUE;
+		g_mutex_unlock (&setcred_mutex);
+
+		return status;
+	}
+#endif
+
  done:
-	/* we're done, close the fd and wake up the main
-	 * loop
+	close_pam_handle (worker, status);
+
+	return status;
+}
+
+static void
+gs_auth_request_cancel (GSAuthRequest *request)
+{
+	g_atomic_int_set (&request->cancelled, TRUE);
+
+	/* A prompt that has not reached the gui yet is answered right
+	 * here, one that is already showing is interrupted through the
+	 * cancellable it was handed.
 	 */
-	close (GPOINTER_TO_INT (auth_operation_fd));
+	if (g_atomic_int_compare_and_exchange (&request->message_state,
+					       GS_AUTH_MESSAGE_QUEUED,
+					       GS_AUTH_MESSAGE_RUNNING)) {
+		gs_auth_finish_message (request, TRUE);
+	}
 
-	return GINT_TO_POINTER(status);
+	g_cancellable_cancel (request->cancellable);
+
+	if (request->loop != NULL) {
+		g_main_loop_quit (request->loop);
+	}
 }
 
 static gboolean
-gs_auth_loop_quit (GIOChannel  *source,
-		   GIOCondition condition,
-		   gboolean    *thread_done)
+gs_auth_request_complete_idle (GSAuthRequest *request)
 {
-	(void) source;
-	(void) condition;
+	request->done = TRUE;
+
+	/* the first service to succeed wins, the other one is told to
+	 * stop asking */
+	if (request->status == PAM_SUCCESS && request->sibling != NULL) {
+		if (gs_auth_get_verbose ()) {
+			g_message ("%s succeeded, cancelling %s",
+				   request->worker->service,
+				   request->sibling->worker->service);
+		}
+
+		gs_auth_request_cancel (request->sibling);
+	}
+
+#ifdef SECONDARY_PAM_SERVICE
+	/* Nothing is waiting in gs_auth_pam_verify_user() to pick this
+	 * success up, the wait after a failure can be long and may never
+	 * end in another attempt, so the dialog is told right away */
+	if (request == secondary_request
+	    && request->status == PAM_SUCCESS
+	    && request->loop == NULL
+	    && ! g_atomic_int_get (&request->cancelled)
+	    && secondary_unlock_func != NULL) {
+		if (gs_auth_get_verbose ()) {
+			g_message ("Authenticated through %s between attempts",
+				   request->worker->service);
+		}
+
+		last_timeline = request->timeline;
+		gs_auth_drop_secondary ();
+		secondary_unlock_func (secondary_unlock_data);
+	}
+#endif
+
+	if (request->loop != NULL) {
+		g_main_loop_quit (request->loop);
+	}
+
+	gs_auth_request_unref (request);
 
-	*thread_done = TRUE;
-	gtk_main_quit ();
 	return FALSE;
 }
 
+#ifdef WITH_DEFERRED_SETCRED
+static void
+run_deferred_setcred (GSAuthWorker *worker)
+{
+	GSAuthTimeline timeline;
+	int            status;
+
+	memset (&timeline, 0, sizeof (timeline));
+
+	status = refresh_credentials (worker->handle, &timeline);
+	if (status != PAM_SUCCESS) {
+		g_warning ("Refreshing credentials after unlocking failed: %s",
+			   PAM_STRERROR (worker->handle, status));
+	} else if (gs_auth_get_verbose ()) {
+		g_message ("Refreshed credentials after unlocking in %" G_GINT64_FORMAT " us",
+			   timeline.setcred);
+	}
+
+	close_pam_handle (worker, PAM_SUCCESS);
+
+	g_mutex_lock (&setcred_mutex);
+	setcred_pending = FALSE;
+	g_cond_broadcast (&setcred_condition);
+	g_mutex_unlock (&setcred_mutex);
+}
+#endif
+
 static gboolean
-gs_auth_pam_verify_user (pam_handle_t *handle,
-			 int          *status)
+gs_auth_pam_get_setcred_pending (void)
 {
-	(void) handle;
+	gboolean pending;
+
+	g_mutex_lock (&setcred_mutex);
+	pending = setcred_pending;
+	g_mutex_unlock (&setcred_mutex);
 
-	GThread    *auth_thread;
-	GIOChannel *channel;
-	guint       watch_id;
-	int         auth_operation_fds[2];
-	int         auth_status;
-	gboolean    thread_done;
+	return pending;
+}
 
-	channel = NULL;
-	watch_id = 0;
-	auth_status = PAM_AUTH_ERR;
+/* Waits for a pam_setcred() that was left running after a success to
+ * finish, returns FALSE if it is still going when the time is up.
+ */
+static gboolean
+gs_auth_pam_wait_for_setcred (guint timeout_seconds)
+{
+	gint64   end_time;
+	gboolean pending;
 
-	/* This pipe gives us a set of fds we can hook into
-	 * the event loop to be notified when our helper thread
-	 * is ready to be reaped.
-	 */
-	if (pipe (auth_operation_fds) < 0) {
-		goto out;
+	end_time = g_get_monotonic_time () + timeout_seconds * G_TIME_SPAN_SECOND;
+
+	g_mutex_lock (&setcred_mutex);
+	while (setcred_pending) {
+		if (! g_cond_wait_until (&setcred_condition, &setcred_mutex, end_time)) {
+			break;
+		}
 	}
+	pending = setcred_pending;
+	g_mutex_unlock (&setcred_mutex);
 
-	if (fcntl (auth_operation_fds[0], F_SETFD, FD_CLOEXEC) < 0) {
-		close (auth_operation_fds[0]);
-		close (auth_operation_fds[1]);
-		goto out;
+	return pending == FALSE;
+}
+
+/* A worker lives for as long as the process does and runs its queued
+ * requests one after the other.  Nothing ever waits for it to finish a
+ * request it has been told to forget about, so a PAM module that sleeps
+ * or hangs only holds up the worker, never the dialog.
+ */
+static gpointer
+gs_auth_worker_func (gpointer data)
+{
+	GSAuthWorker *worker = data;
+
+	for (;;) {
+		GSAuthRequest *request;
+		int            status;
+
+		request = g_async_queue_pop (worker->queue);
+
+		if (g_atomic_int_get (&request->cancelled)) {
+			status = PAM_CONV_ERR;
+		} else {
+			status = gs_auth_worker_run (request);
+		}
+		request->status = status;
+
+		/* hands our reference over to the main thread */
+		g_idle_add ((GSourceFunc) gs_auth_request_complete_idle, request);
+
+#ifdef WITH_DEFERRED_SETCRED
+		if (status == PAM_SUCCESS) {
+			run_deferred_setcred (worker);
+		}
+#endif
 	}
 
-	if (fcntl (auth_operation_fds[1], F_SETFD, FD_CLOEXEC) < 0) {
-		close (auth_operation_fds[0]);
-		close (auth_operation_fds[1]);
-		goto out;
+	return NULL;
+}
+
+static gboolean
+gs_auth_ensure_worker (GSAuthWorker *worker,
+		       GError      **error)
+{
+	if (worker->thread != NULL) {
+		return TRUE;
 	}
 
-	channel = g_io_channel_unix_new (auth_operation_fds[0]);
+	if (response_buffer == NULL) {
+		response_buffer = gs_secure_buffer_new ();
+	}
 
-	/* we use a recursive main loop to process ui events
-	 * while we wait on a thread to handle the blocking parts
-	 * of pam authentication.
-	 */
-	thread_done = FALSE;
-	watch_id = g_io_add_watch (channel, G_IO_ERR | G_IO_HUP,
-				   (GIOFunc) gs_auth_loop_quit, &thread_done);
+	if (notify_fds[0] < 0) {
+		GIOChannel *channel;
+
+		if (! wakeup_open (notify_fds) || ! wakeup_open (reply_fds)) {
+			g_set_error (error,
+				     GS_AUTH_ERROR,
+				     GS_AUTH_ERROR_GENERAL,
+				     "Unable to set up the authentication mailbox: %s",
+				     g_strerror (errno));
+			wakeup_close (notify_fds);
+			wakeup_close (reply_fds);
+			return FALSE;
+		}
+
+		channel = g_io_channel_unix_new (notify_fds[0]);
+		g_io_add_watch (channel, G_IO_IN,
+				(GIOFunc) gs_auth_mailbox_cb, NULL);
+		g_io_channel_unref (channel);
+	}
 
-	auth_thread = g_thread_new (NULL, (GThreadFunc) gs_auth_thread_func,
-				       GINT_TO_POINTER (auth_operation_fds[1]));
+	worker->queue = g_async_queue_new ();
+	worker->thread = g_thread_try_new ("gs-auth-worker",
+					   gs_auth_worker_func,
+					   worker,
+					   error);
 
-	if (auth_thread == NULL) {
-		goto out;
+	if (worker->thread == NULL) {
+		g_async_queue_unref (worker->queue);
+		worker->queue = NULL;
+		return FALSE;
 	}
 
-	gtk_main ();
+	return TRUE;
+}
 
-	/* if the event loop was quit before the thread is done then we can't
-	 * reap the thread without blocking on it finishing.  The
-	 * thread may not ever finish though if the pam module is blocking.
-	 *
-	 * The only time the event loop is going to stop when the thread isn't
-	 * done, however, is if the dialog quits early (from, e.g., "cancel"),
-	 * so we can just exit.  An alternative option would be to switch to
-	 * using pthreads directly and calling pthread_cancel.
-	 */
-	if (!thread_done) {
-		raise (SIGTERM);
+static void
+gs_auth_request_cancelled_cb (GCancellable  *cancellable,
+			      GSAuthRequest *request)
+{
+	(void) cancellable;
+
+	gs_auth_request_cancel (request);
+
+#ifdef SECONDARY_PAM_SERVICE
+	/* the dialog is going away, nobody is left to unlock for */
+	if (secondary_request != NULL) {
+		gs_auth_request_cancel (secondary_request);
 	}
+#endif
+}
 
-	auth_status = GPOINTER_TO_INT (g_thread_join (auth_thread));
+#ifdef SECONDARY_PAM_SERVICE
+static void
+gs_auth_drop_secondary (void)
+{
+	gs_auth_request_cancel (secondary_request);
+	gs_auth_request_unref (secondary_request);
+	secondary_request = NULL;
+}
 
- out:
-	if (watch_id != 0) {
-		g_source_remove (watch_id);
+/* Makes sure the second service is waiting alongside the password
+ * one.  A request that is still running from an earlier attempt is
+ * picked up again rather than queued behind, a fingerprint reader
+ * shouldn't stop listening because the password was mistyped.
+ */
+static GSAuthRequest *
+gs_auth_start_secondary (const char *username,
+			 const char *display)
+{
+	GError *error = NULL;
+
+	if (secondary_request != NULL
+	    && (g_atomic_int_get (&secondary_request->cancelled)
+		|| (secondary_request->done && secondary_request->status != PAM_SUCCESS)
+		|| g_strcmp0 (secondary_request->username, username) != 0
+		|| g_strcmp0 (secondary_request->display, display) != 0)) {
+		gs_auth_drop_secondary ();
 	}
 
-	if (channel != NULL) {
-		g_io_channel_unref (channel);
+	if (secondary_request != NULL) {
+		return secondary_request;
 	}
 
-	if (status) {
-		*status = auth_status;
+	if (! gs_auth_ensure_worker (&secondary_worker, &error)) {
+		g_warning ("Unable to start the %s service: %s",
+			   secondary_worker.service,
+			   error->message);
+		g_error_free (error);
+		return NULL;
 	}
 
-	return auth_status == PAM_SUCCESS;
+	secondary_request = gs_auth_request_new (&secondary_worker, username, display, NULL, NULL);
+	secondary_request->timeline.started = g_get_monotonic_time ();
+	g_async_queue_push (secondary_worker.queue, gs_auth_request_ref (secondary_request));
+
+	return secondary_request;
 }
 
-gboolean
-gs_auth_verify_user (const char       *username,
-		     const char       *display,
-		     GSAuthMessageFunc func,
-		     gpointer          data,
-		     GError          **error)
+static void
+gs_auth_pam_start_second_factor (const char      *username,
+				 const char      *display,
+				 GSAuthUnlockFunc func,
+				 gpointer         data)
 {
-	int                status = -1;
-	struct pam_conv    conv;
-	struct pam_closure c;
-	struct passwd     *pwent;
+	secondary_unlock_func = func;
+	secondary_unlock_data = data;
+
+	gs_auth_start_secondary (username, display);
+}
+#endif
+
+static gboolean
+gs_auth_pam_verify_user (const char       *username,
+			 const char       *display,
+			 GSAuthMessageFunc func,
+			 gpointer          data,
+			 GCancellable     *cancellable,
+			 GError          **error)
+{
+	GSAuthRequest *request;
+	GSAuthRequest *secondary;
+	GMainLoop     *loop;
+	gulong         cancelled_id;
+	int            status;
+	gboolean       did_we_ask_for_password;
+
+	memset (&last_timeline, 0, sizeof (last_timeline));
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_set_error (error,
+			     GS_AUTH_ERROR,
+			     GS_AUTH_ERROR_CANCELLED,
+			     "%s",
+			     _("Authentication was cancelled."));
+		return FALSE;
+	}
 
-	pwent = getpwnam (username);
-	if (pwent == NULL) {
+	if (! gs_auth_ensure_worker (&password_worker, error)) {
 		return FALSE;
 	}
 
-	c.username = username;
-	c.cb_func = func;
-	c.cb_data = data;
+	request = gs_auth_request_new (&password_worker, username, display, func, data);
 
-	conv.conv = &pam_conversation;
-	conv.appdata_ptr = (void *) &c;
+	secondary = NULL;
+#ifdef SECONDARY_PAM_SERVICE
+	secondary = gs_auth_start_secondary (username, display);
+#endif
 
-	/* Initialize PAM. */
-	create_pam_handle (username, display, &conv, &status);
-	if (status != PAM_SUCCESS) {
-		goto done;
+	/* we use a recursive main loop to process ui events
+	 * while the workers handle the blocking parts of pam
+	 * authentication.
+	 */
+	loop = g_main_loop_new (NULL, FALSE);
+	request->loop = loop;
+
+	if (secondary != NULL) {
+		secondary->loop = loop;
+		secondary->sibling = request;
+		request->sibling = secondary;
 	}
 
-	pam_set_item (pam_handle, PAM_USER_PROMPT, _("Username:"));
+	cancelled_id = g_cancellable_connect (cancellable,
+					      G_CALLBACK (gs_auth_request_cancelled_cb),
+					      request,
+					      NULL);
 
-	PAM_NO_DELAY(pam_handle);
+	request->timeline.started = g_get_monotonic_time ();
+	g_async_queue_push (password_worker.queue, gs_auth_request_ref (request));
 
-	did_we_ask_for_password = FALSE;
-	if (! gs_auth_pam_verify_user (pam_handle, &status)) {
-		goto done;
+	while (! request->done && ! g_atomic_int_get (&request->cancelled)) {
+		if (secondary != NULL && secondary->done) {
+			if (secondary->status == PAM_SUCCESS) {
+				/* it may have won before we even got here */
+				gs_auth_request_cancel (request);
+				break;
+			}
+
+			/* a failed second factor leaves it to the password */
+			secondary->loop = NULL;
+			secondary->sibling = NULL;
+			request->sibling = NULL;
+			secondary = NULL;
+			continue;
+		}
+
+		g_main_loop_run (loop);
 	}
 
- done:
-	if (status != PAM_SUCCESS) {
-		set_pam_error (error, status);
+	g_cancellable_disconnect (cancellable, cancelled_id);
+
+	if (secondary != NULL) {
+		secondary->loop = NULL;
+		secondary->sibling = NULL;
+	}
+	request->sibling = NULL;
+	request->loop = NULL;
+	g_main_loop_unref (loop);
+
+#ifdef SECONDARY_PAM_SERVICE
+	if (secondary != NULL && secondary->done && secondary->status == PAM_SUCCESS) {
+		if (gs_auth_get_verbose ()) {
+			g_message ("Authenticated through %s", secondary->worker->service);
+		}
+
+		last_timeline = secondary->timeline;
+
+		/* the password request is left to its worker */
+		gs_auth_request_unref (request);
+		gs_auth_drop_secondary ();
+
+		return TRUE;
+	}
+#endif
+
+	if (! request->done) {
+		/* the worker keeps its own reference and drops it
+		 * whenever the PAM stack lets go */
+		if (gs_auth_get_verbose ()) {
+			g_message ("Authentication cancelled before the PAM stack returned");
+		}
+
+		g_set_error (error,
+			     GS_AUTH_ERROR,
+			     GS_AUTH_ERROR_CANCELLED,
+			     "%s",
+			     _("Authentication was cancelled."));
+		gs_auth_request_unref (request);
+
+		return FALSE;
 	}
 
-	close_pam_handle (status);
+	last_timeline = request->timeline;
+
+	status = request->status;
+	did_we_ask_for_password = request->did_we_ask_for_password;
+	gs_auth_request_unref (request);
+
+	if (status != PAM_SUCCESS) {
+		set_pam_error (error, status, did_we_ask_for_password);
+	}
 
 	return (status == PAM_SUCCESS ? TRUE : FALSE);
 }
 
-gboolean
-gs_auth_init (void)
+static gboolean
+gs_auth_pam_init (void)
 {
 	return TRUE;
 }
 
-gboolean
-gs_auth_priv_init (void)
+static gboolean
+gs_auth_pam_priv_init (void)
 {
 	/* We have nothing to do at init-time.
 	   However, we might as well do some error checking.
@@ -764,3 +1468,19 @@ gs_auth_priv_init (void)
 	/* Return true anyway, just in case. */
 	return TRUE;
 }
+
+const GSAuthBackend gs_auth_pam_backend = {
+	"pam",
+	gs_auth_pam_priv_init,
+	gs_auth_pam_init,
+	gs_auth_pam_verify_user,
+	gs_auth_pam_get_message_time,
+	gs_auth_pam_get_timeline,
+	gs_auth_pam_get_setcred_pending,
+	gs_auth_pam_wait_for_setcred,
+#ifdef SECONDARY_PAM_SERVICE
+	gs_auth_pam_start_second_factor,
+#else
+	NULL,
+#endif
+};
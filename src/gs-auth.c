@@ -0,0 +1,268 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <errno.h>
+#include <pwd.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "gs-auth.h"
+#include "gs-auth-backend.h"
+
+/* The first one is the default */
+static const GSAuthBackend *backends[] = {
+#ifdef WITH_BSD_AUTH
+	&gs_auth_bsdauth_backend,
+#else
+	&gs_auth_pam_backend,
+#endif
+	NULL
+};
+
+static const GSAuthBackend *backend = NULL;
+static gboolean             verbose_enabled = FALSE;
+
+/* How often the user's passwd entry is looked up again, to keep the
+ * caches of sssd, nscd and the like from expiring while we are locked.
+ */
+#define USER_REFRESH_INTERVAL (5 * 60)
+
+/* The lookups happen on their own thread so that an attempt never
+ * waits for NSS.  What they find is only logged: whether the user
+ * exists is for the backend to decide, a directory that is briefly
+ * unreachable must not lock anybody out.
+ */
+static GThread *user_thread = NULL;
+
+static const GSAuthBackend *
+get_backend (void)
+{
+	if (backend == NULL) {
+		backend = backends[0];
+	}
+
+	return backend;
+}
+
+GQuark
+gs_auth_error_quark (void)
+{
+	static GQuark quark = 0;
+	if (! quark) {
+		quark = g_quark_from_static_string ("gs_auth_error");
+	}
+
+	return quark;
+}
+
+void
+gs_auth_set_verbose (gboolean enabled)
+{
+	verbose_enabled = enabled;
+}
+
+gboolean
+gs_auth_get_verbose (void)
+{
+	return verbose_enabled;
+}
+
+gboolean
+gs_auth_set_backend (const char *name)
+{
+	int i;
+
+	g_return_val_if_fail (name != NULL, FALSE);
+
+	for (i = 0; backends[i] != NULL; i++) {
+		if (strcmp (backends[i]->name, name) == 0) {
+			backend = backends[i];
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void
+gs_auth_use_backend (const GSAuthBackend *impl)
+{
+	g_return_if_fail (impl != NULL);
+
+	backend = impl;
+}
+
+const char *
+gs_auth_get_backend (void)
+{
+	return get_backend ()->name;
+}
+
+gboolean
+gs_auth_priv_init (void)
+{
+	return get_backend ()->priv_init ();
+}
+
+gboolean
+gs_auth_init (void)
+{
+	return get_backend ()->init ();
+}
+
+static const char *
+lookup_user (const char *username)
+{
+	struct passwd  pwent;
+	struct passwd *result;
+	char          *buf;
+	long           size;
+	int            res;
+
+	size = sysconf (_SC_GETPW_R_SIZE_MAX);
+	if (size <= 0) {
+		size = 16384;
+	}
+
+	buf = g_malloc (size);
+	while ((res = getpwnam_r (username, &pwent, buf, size, &result)) == ERANGE) {
+		size *= 2;
+		buf = g_realloc (buf, size);
+	}
+	g_free (buf);
+
+	if (result != NULL) {
+		return "found";
+	}
+
+	/* an unreachable directory is not a missing user */
+	if (res == 0 || res == ENOENT) {
+		return "not found";
+	}
+
+	return g_strerror (res);
+}
+
+static gpointer
+user_thread_func (gpointer data)
+{
+	const char *username;
+
+	(void) data;
+
+	/* this also fills in glib's idea of who we are, which the dialog
+	 * asks for on every attempt */
+	username = g_get_user_name ();
+
+	for (;;) {
+		const char *lookup;
+		gint64      start;
+
+		start = g_get_monotonic_time ();
+		lookup = lookup_user (username);
+
+		if (gs_auth_get_verbose ()) {
+			g_message ("Looked up user %s in %" G_GINT64_FORMAT " us: %s",
+				   username,
+				   g_get_monotonic_time () - start,
+				   lookup);
+		}
+
+		g_usleep (USER_REFRESH_INTERVAL * G_USEC_PER_SEC);
+	}
+
+	return NULL;
+}
+
+/* Starts looking up the user running us in the background, and keeps
+ * doing so every so often for as long as we run.
+ */
+void
+gs_auth_prewarm (void)
+{
+	GError *error = NULL;
+
+	if (user_thread != NULL) {
+		return;
+	}
+
+	user_thread = g_thread_try_new ("gs-auth-nss",
+					user_thread_func,
+					NULL,
+					&error);
+
+	if (user_thread == NULL) {
+		g_warning ("Unable to start looking up the user: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+gboolean
+gs_auth_verify_user (const char       *username,
+		     const char       *display,
+		     GSAuthMessageFunc func,
+		     gpointer          data,
+		     GCancellable     *cancellable,
+		     GError          **error)
+{
+	return get_backend ()->verify_user (username, display, func, data, cancellable, error);
+}
+
+/* Gets the second factor, if there is one, waiting before the first
+ * attempt and between attempts, not only while one is running.
+ */
+void
+gs_auth_start_second_factor (const char      *username,
+			     const char      *display,
+			     GSAuthUnlockFunc func,
+			     gpointer         data)
+{
+	if (get_backend ()->start_second_factor != NULL) {
+		get_backend ()->start_second_factor (username, display, func, data);
+	}
+}
+
+gint64
+gs_auth_get_message_time (void)
+{
+	return get_backend ()->get_message_time ();
+}
+
+void
+gs_auth_get_timeline (GSAuthTimeline *timeline)
+{
+	get_backend ()->get_timeline (timeline);
+}
+
+gboolean
+gs_auth_get_setcred_pending (void)
+{
+	return get_backend ()->get_setcred_pending ();
+}
+
+gboolean
+gs_auth_wait_for_setcred (guint timeout_seconds)
+{
+	return get_backend ()->wait_for_setcred (timeout_seconds);
+}
@@ -23,8 +23,11 @@
 #define __GS_AUTH_H
 
 #include <glib.h>
+#include <gio/gio.h>
 #include <sys/stat.h>
 
+#include "gs-secure-buffer.h"
+
 G_BEGIN_DECLS
 
 typedef enum {
@@ -38,10 +41,41 @@ typedef enum {
 	GS_AUTH_ERROR_GENERAL,
 	GS_AUTH_ERROR_AUTH_ERROR,
 	GS_AUTH_ERROR_USER_UNKNOWN,
-	GS_AUTH_ERROR_AUTH_DENIED
+	GS_AUTH_ERROR_AUTH_DENIED,
+	GS_AUTH_ERROR_CANCELLED
 } GSAuthError;
 
-typedef gboolean (*GSAuthMessageFunc)(GSAuthMessageStyle style, const char* msg, char** response, gpointer data);
+/* Where the time of the last attempt went.  started is on the monotonic
+ * clock, everything else is a duration in microseconds.  conversation is
+ * the part of authenticate spent on prompts, handoff the part of that
+ * spent getting them to the gui.  fail_delay is not time spent but the
+ * wait the stack asked for before the next attempt.
+ */
+typedef struct {
+	gint64 started;
+	gint64 setup;
+	gint64 authenticate;
+	gint64 acct_mgmt;
+	gint64 setcred;
+	gint64 conversation;
+	gint64 handoff;
+	guint n_prompts;
+	gint64 fail_delay;
+} GSAuthTimeline;
+
+/* A prompt is answered by filling in response, which the backend owns
+ * and reuses, and returning TRUE.  cancellable is cancelled once the
+ * answer is no longer wanted, e.g. because another service has already
+ * authenticated the user.
+ */
+typedef gboolean (*GSAuthMessageFunc)(GSAuthMessageStyle style, const char* msg, GSSecureBuffer* response, GCancellable* cancellable, gpointer data);
+
+/* Called on the main thread when a second factor authenticates the user
+ * while no gs_auth_verify_user() is running to pick it up, e.g. in the
+ * wait after a failed attempt.  gs_auth_get_timeline() then describes
+ * that second factor's attempt.
+ */
+typedef void (*GSAuthUnlockFunc)(gpointer data);
 
 #define GS_AUTH_ERROR gs_auth_error_quark()
 
@@ -50,9 +84,18 @@ GQuark gs_auth_error_quark(void);
 void gs_auth_set_verbose(gboolean verbose);
 gboolean gs_auth_get_verbose(void);
 
+gboolean gs_auth_set_backend(const char* name);
+const char* gs_auth_get_backend(void);
+
 gboolean gs_auth_priv_init(void);
 gboolean gs_auth_init(void);
-gboolean gs_auth_verify_user(const char* username, const char* display, GSAuthMessageFunc func, gpointer data, GError** error);
+void gs_auth_prewarm(void);
+gint64 gs_auth_get_message_time(void);
+void gs_auth_get_timeline(GSAuthTimeline* timeline);
+gboolean gs_auth_get_setcred_pending(void);
+gboolean gs_auth_wait_for_setcred(guint timeout_seconds);
+gboolean gs_auth_verify_user(const char* username, const char* display, GSAuthMessageFunc func, gpointer data, GCancellable* cancellable, GError** error);
+void gs_auth_start_second_factor(const char* username, const char* display, GSAuthUnlockFunc func, gpointer data);
 
 G_END_DECLS
 
@@ -0,0 +1,209 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gs-backoff.h"
+#include "gs-clock.h"
+#include "gs-debug.h"
+
+#ifndef AUTH_BACKOFF_INITIAL
+#define AUTH_BACKOFF_INITIAL 1000
+#endif
+
+#ifndef AUTH_BACKOFF_MAX
+#define AUTH_BACKOFF_MAX 30000
+#endif
+
+/* How long to wait after a failed unlock attempt.  The first failure
+ * costs AUTH_BACKOFF_INITIAL milliseconds, every further one doubles
+ * that up to AUTH_BACKOFF_MAX, and a success starts over.
+ *
+ * The daemon starts a new dialog whenever the old one goes away, so the
+ * count and the end of the current wait are kept in XDG_RUNTIME_DIR:
+ * killing the dialog, or giving up after MAX_FAILURES, doesn't get
+ * anyone out of waiting.  The deadline is on the boot time clock, which
+ * is shared between processes and keeps going across a suspend.
+ */
+static guint  failures = 0;
+static gint64 deadline = 0;
+
+static char *
+get_state_file (void)
+{
+	const char *runtime_dir;
+
+	runtime_dir = g_getenv ("XDG_RUNTIME_DIR");
+	if (runtime_dir == NULL || runtime_dir[0] == '\0') {
+		return NULL;
+	}
+
+	return g_build_filename (runtime_dir, "budgie-screensaver", "auth-backoff", NULL);
+}
+
+static void
+save_state (void)
+{
+	char *filename;
+	char *dirname;
+	char *tmpname;
+	char *contents;
+	int   fd;
+
+	filename = get_state_file ();
+	if (filename == NULL) {
+		return;
+	}
+
+	dirname = g_path_get_dirname (filename);
+	tmpname = g_strconcat (filename, ".XXXXXX", NULL);
+	contents = g_strdup_printf ("%u %" G_GINT64_FORMAT "\n", failures, deadline);
+
+	if (g_mkdir_with_parents (dirname, 0700) < 0) {
+		gs_debug ("Unable to create %s: %s", dirname, g_strerror (errno));
+		goto out;
+	}
+
+	/* written beside the old one and renamed over it, so that a dialog
+	 * killed half way through leaves either the old or the new state */
+	fd = g_mkstemp (tmpname);
+	if (fd < 0) {
+		gs_debug ("Unable to save the backoff state: %s", g_strerror (errno));
+		goto out;
+	}
+
+	if (write (fd, contents, strlen (contents)) < 0
+	    || close (fd) < 0
+	    || g_rename (tmpname, filename) < 0) {
+		gs_debug ("Unable to save the backoff state: %s", g_strerror (errno));
+		g_unlink (tmpname);
+	}
+
+ out:
+	g_free (contents);
+	g_free (tmpname);
+	g_free (dirname);
+	g_free (filename);
+}
+
+void
+gs_backoff_load (void)
+{
+	char   *filename;
+	char   *contents;
+	char   *end;
+	gint64  now;
+	gint64  latest;
+
+	failures = 0;
+	deadline = 0;
+
+	filename = get_state_file ();
+	if (filename == NULL
+	    || ! g_file_get_contents (filename, &contents, NULL, NULL)) {
+		g_free (filename);
+		return;
+	}
+
+	failures = (guint) strtoul (contents, &end, 10);
+	deadline = g_ascii_strtoll (end, NULL, 10);
+
+	/* a deadline further out than any we would have set can only
+	 * come from an earlier boot, don't wait longer than the longest
+	 * delay */
+	now = gs_clock_get_boottime ();
+	latest = now + (gint64) AUTH_BACKOFF_MAX * 1000;
+	if (deadline > latest) {
+		deadline = latest;
+	}
+
+	gs_debug ("Loaded backoff state: %u failures, %u ms left",
+		  failures, gs_backoff_get_remaining ());
+
+	g_free (contents);
+	g_free (filename);
+}
+
+/* what is left of the current wait */
+guint
+gs_backoff_get_remaining (void)
+{
+	gint64 now;
+
+	now = gs_clock_get_boottime ();
+	if (deadline <= now) {
+		return 0;
+	}
+
+	return (guint) ((deadline - now + 999) / 1000);
+}
+
+/* Counts a failure and returns how long to wait before the next
+ * attempt: the larger of our own delay and the one the authentication
+ * stack asked for.
+ */
+guint
+gs_backoff_failed (guint requested)
+{
+	guint64 delay;
+	guint   i;
+
+	failures++;
+
+	delay = AUTH_BACKOFF_INITIAL;
+	for (i = 1; i < failures && delay < AUTH_BACKOFF_MAX; i++) {
+		delay *= 2;
+	}
+	delay = MIN (delay, AUTH_BACKOFF_MAX);
+	delay = MAX (delay, requested);
+
+	deadline = gs_clock_get_boottime () + (gint64) delay * 1000;
+	save_state ();
+
+	gs_debug ("Failure %u, waiting %u ms", failures, (guint) delay);
+
+	return (guint) delay;
+}
+
+void
+gs_backoff_reset (void)
+{
+	char *filename;
+
+	failures = 0;
+	deadline = 0;
+
+	filename = get_state_file ();
+	if (filename != NULL) {
+		g_unlink (filename);
+	}
+
+	g_free (filename);
+}
@@ -0,0 +1,246 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+
+#include "gs-bus-watch.h"
+#include "gs-debug.h"
+
+/* Delay before retrying a failed or lost connection, doubled after
+ * every failed attempt up to the maximum (milliseconds) */
+#define RETRY_DELAY_MIN 1000
+#define RETRY_DELAY_MAX 60000
+
+typedef struct {
+	GBusType         bus_type;
+	const char      *name;
+	GDBusConnection *connection;
+	GCancellable    *cancellable;
+	guint            retry_id;
+	guint            retry_delay;
+	GList           *watches;
+} GSBus;
+
+typedef struct {
+	guint            id;
+	GSBusWatchFunc   connected;
+	GSBusWatchFunc   lost;
+	gpointer         data;
+} GSBusWatch;
+
+/* One private connection per bus, shared by everybody in the daemon.
+ * Only ever used from the main thread.
+ */
+static GSBus system_bus  = { G_BUS_TYPE_SYSTEM, "system", NULL, NULL, 0, RETRY_DELAY_MIN, NULL };
+static GSBus session_bus = { G_BUS_TYPE_SESSION, "session", NULL, NULL, 0, RETRY_DELAY_MIN, NULL };
+
+static guint next_watch_id = 1;
+
+static void bus_connect (GSBus *bus);
+
+static gboolean
+bus_retry_timeout (GSBus *bus)
+{
+	bus->retry_id = 0;
+	bus_connect (bus);
+
+	return FALSE;
+}
+
+static void
+bus_schedule_retry (GSBus *bus)
+{
+	if (bus->retry_id > 0) {
+		return;
+	}
+
+	gs_debug ("Connecting to the %s bus again in %u ms", bus->name, bus->retry_delay);
+
+	bus->retry_id = g_timeout_add (bus->retry_delay, (GSourceFunc) bus_retry_timeout, bus);
+	bus->retry_delay = MIN (bus->retry_delay * 2, RETRY_DELAY_MAX);
+}
+
+static void
+bus_closed_cb (GDBusConnection *connection,
+	       gboolean         remote_peer_vanished,
+	       GError          *error,
+	       GSBus           *bus)
+{
+	(void) remote_peer_vanished;
+
+	GList *l;
+
+	g_message ("Got disconnected from the %s message bus%s%s",
+		   bus->name,
+		   error != NULL ? ": " : "",
+		   error != NULL ? error->message : "");
+
+	g_signal_handlers_disconnect_by_func (connection, bus_closed_cb, bus);
+
+	for (l = bus->watches; l != NULL; l = l->next) {
+		GSBusWatch *watch = l->data;
+
+		if (watch->lost != NULL) {
+			watch->lost (connection, watch->data);
+		}
+	}
+
+	g_object_unref (bus->connection);
+	bus->connection = NULL;
+
+	bus_schedule_retry (bus);
+}
+
+static void
+bus_connected_cb (GObject      *source,
+		  GAsyncResult *result,
+		  GSBus        *bus)
+{
+	(void) source;
+
+	GDBusConnection *connection;
+	GError          *error;
+	GList           *l;
+
+	error = NULL;
+	connection = g_dbus_connection_new_for_address_finish (result, &error);
+
+	g_clear_object (&bus->cancellable);
+
+	if (connection == NULL) {
+		g_warning ("Couldn't connect to the %s bus: %s", bus->name, error->message);
+		g_error_free (error);
+		bus_schedule_retry (bus);
+		return;
+	}
+
+	gs_debug ("Connected to the %s bus", bus->name);
+
+	bus->connection = connection;
+	bus->retry_delay = RETRY_DELAY_MIN;
+
+	g_dbus_connection_set_exit_on_close (connection, FALSE);
+	g_signal_connect (connection, "closed",
+			  G_CALLBACK (bus_closed_cb), bus);
+
+	for (l = bus->watches; l != NULL; l = l->next) {
+		GSBusWatch *watch = l->data;
+
+		watch->connected (connection, watch->data);
+	}
+}
+
+/* Never blocks on the bus itself, the address only comes from the
+ * environment or the well known defaults */
+static void
+bus_connect (GSBus *bus)
+{
+	GError *error;
+	char   *address;
+
+	if (bus->connection != NULL || bus->cancellable != NULL) {
+		return;
+	}
+
+	error = NULL;
+	address = g_dbus_address_get_for_bus_sync (bus->bus_type, NULL, &error);
+	if (address == NULL) {
+		g_warning ("Couldn't find the %s bus: %s", bus->name, error->message);
+		g_error_free (error);
+		bus_schedule_retry (bus);
+		return;
+	}
+
+	bus->cancellable = g_cancellable_new ();
+
+	g_dbus_connection_new_for_address (address,
+					   G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+					   | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+					   NULL,
+					   bus->cancellable,
+					   (GAsyncReadyCallback) bus_connected_cb,
+					   bus);
+
+	g_free (address);
+}
+
+guint
+gs_bus_watch (GBusType       bus_type,
+	      GSBusWatchFunc connected,
+	      GSBusWatchFunc lost,
+	      gpointer       data)
+{
+	GSBusWatch *watch;
+	GSBus      *bus;
+
+	g_return_val_if_fail (bus_type == G_BUS_TYPE_SYSTEM || bus_type == G_BUS_TYPE_SESSION, 0);
+	g_return_val_if_fail (connected != NULL, 0);
+
+	bus = bus_type == G_BUS_TYPE_SYSTEM ? &system_bus : &session_bus;
+
+	watch = g_new0 (GSBusWatch, 1);
+	watch->id = next_watch_id++;
+	watch->connected = connected;
+	watch->lost = lost;
+	watch->data = data;
+
+	bus->watches = g_list_append (bus->watches, watch);
+
+	if (bus->connection != NULL) {
+		connected (bus->connection, data);
+	} else {
+		bus_connect (bus);
+	}
+
+	return watch->id;
+}
+
+static gboolean
+bus_remove_watch (GSBus *bus,
+		  guint  id)
+{
+	GList *l;
+
+	for (l = bus->watches; l != NULL; l = l->next) {
+		GSBusWatch *watch = l->data;
+
+		if (watch->id == id) {
+			bus->watches = g_list_delete_link (bus->watches, l);
+			g_free (watch);
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* The connection itself stays up for whoever watches next */
+void
+gs_bus_unwatch (guint id)
+{
+	g_return_if_fail (id > 0);
+
+	if (! bus_remove_watch (&system_bus, id)
+	    && ! bus_remove_watch (&session_bus, id)) {
+		g_warning ("Invalid bus watch id %u", id);
+	}
+}
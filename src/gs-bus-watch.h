@@ -0,0 +1,37 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_BUS_WATCH_H
+#define __GS_BUS_WATCH_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef void (*GSBusWatchFunc)(GDBusConnection* connection, gpointer data);
+
+/* connected runs every time the bus comes up, right away if it
+ * already is, and lost every time it goes away again */
+guint gs_bus_watch(GBusType bus_type, GSBusWatchFunc connected, GSBusWatchFunc lost, gpointer data);
+void gs_bus_unwatch(guint id);
+
+G_END_DECLS
+
+#endif /* __GS_BUS_WATCH_H */
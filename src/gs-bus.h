@@ -51,6 +51,9 @@
 #define GS_PATH "/org/gnome/ScreenSaver"
 #define GS_INTERFACE "org.gnome.ScreenSaver"
 
+/* Budgie Screensaver */
+#define GS_STATS_INTERFACE "org.buddiesofbudgie.ScreenSaver.Stats"
+
 /* Gnome Session Manager */
 #define GSM_SERVICE "org.gnome.SessionManager"
 #define GSM_PATH "/org/gnome/SessionManager"
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <time.h>
+
+#include <glib.h>
+
+#include "gs-clock.h"
+
+/* CLOCK_BOOTTIME is CLOCK_MONOTONIC plus the time spent suspended.
+ * Where it is missing we fall back to the monotonic clock, which at
+ * least never jumps with wall clock changes.
+ */
+gint64
+gs_clock_get_boottime (void)
+{
+#ifdef CLOCK_BOOTTIME
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_BOOTTIME, &ts) == 0) {
+		return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+	}
+#endif
+
+	return g_get_monotonic_time ();
+}
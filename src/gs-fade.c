@@ -39,6 +39,7 @@
 #include <gtk/gtk.h>
 
 #include "gs-fade.h"
+#include "gs-stats.h"
 #include "gs-debug.h"
 
 #define GNOME_DESKTOP_USE_UNSTABLE_API
@@ -102,6 +103,8 @@ struct _GSFadePrivate
 	gdouble          alpha_per_iter;
 	gdouble          current_alpha;
 
+	gint64           start_time;
+
 	int              num_screens;
 
 	struct GSFadeScreenPrivate *screen_priv;
@@ -685,6 +688,8 @@ gs_fade_finish (GSFade *fade)
 
 	gs_fade_stop (fade);
 
+	gs_stats_add ("fade", g_get_monotonic_time () - fade->priv->start_time);
+
 	g_signal_emit (fade, signals [FADED], 0);
 
 	fade->priv->active = FALSE;
@@ -749,6 +754,7 @@ gs_fade_start (GSFade *fade,
 	}
 
 	fade->priv->active = TRUE;
+	fade->priv->start_time = g_get_monotonic_time ();
 
 	gs_fade_set_timeout (fade, timeout);
 
@@ -35,6 +35,7 @@
 
 #include "gs-window.h"
 #include "gs-grab.h"
+#include "gs-stats.h"
 #include "gs-debug.h"
 
 static void     gs_grab_class_init (GSGrabClass *klass);
@@ -266,6 +267,7 @@ gs_grab_move_grab (GSGrab    *grab,
 		struct timespec remaining, request = {0, 2.5e8};
 		nanosleep (&request, &remaining); // wait for 250 ms
 		result = gs_grab_seat_grab (grab, window, hide_cursor);
+		gs_stats_count ("grab-retries", 1);
 	}
 
 	if ((result != GDK_GRAB_SUCCESS) && old_window) {
@@ -280,6 +282,24 @@ gs_grab_move_grab (GSGrab    *grab,
 	return (result == GDK_GRAB_SUCCESS);
 }
 
+/* whether the seat is still grabbed to window, a grab that was taken
+ * away from us without a grab-broken event counts as lost */
+gboolean
+gs_grab_is_grabbed_on (GSGrab    *grab,
+		       GdkWindow *window)
+{
+	g_return_val_if_fail (GS_IS_GRAB (grab), FALSE);
+
+	if (window == NULL
+	    || grab->priv->seat == NULL
+	    || grab->priv->seat_grab_window != window) {
+		return FALSE;
+	}
+
+	return gdk_display_device_is_grabbed (gdk_display_get_default (),
+					      gdk_seat_get_pointer (grab->priv->seat));
+}
+
 void
 gs_grab_release (GSGrab *grab)
 {
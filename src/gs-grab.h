@@ -63,6 +63,8 @@ void gs_grab_move_to_window(GSGrab* grab, GdkWindow* window, gboolean hide_curso
 void gs_grab_seat_ungrab(GSGrab* grab);
 void gs_grab_seat_reset(GSGrab* grab);
 
+gboolean gs_grab_is_grabbed_on(GSGrab* grab, GdkWindow* window);
+
 G_END_DECLS
 
 #endif /* __GS_GRAB_H */
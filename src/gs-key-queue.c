@@ -0,0 +1,135 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "gs-key-queue.h"
+
+/* A fixed size ring of the bits of a key press that are needed to replay
+ * it later.  It is embedded in its owner, so queueing a key never
+ * allocates, and since the keys are very likely part of a password the
+ * records are wiped as soon as they have been used.
+ */
+
+gboolean
+gs_key_queue_push (GSKeyQueue        *queue,
+		   const GdkEventKey *event)
+{
+	GSKeyRecord *record;
+
+	g_return_val_if_fail (queue != NULL, FALSE);
+	g_return_val_if_fail (event != NULL, FALSE);
+
+	/* keep the oldest keys, they are the start of what was typed */
+	if (queue->length == GS_KEY_QUEUE_SIZE) {
+		return FALSE;
+	}
+
+	record = &queue->records[(queue->head + queue->length) & (GS_KEY_QUEUE_SIZE - 1)];
+	record->time = event->time;
+	record->state = event->state;
+	record->keyval = event->keyval;
+	record->hardware_keycode = event->hardware_keycode;
+	record->group = event->group;
+	record->is_modifier = event->is_modifier;
+
+	queue->length++;
+
+	return TRUE;
+}
+
+guint
+gs_key_queue_get_length (GSKeyQueue *queue)
+{
+	g_return_val_if_fail (queue != NULL, 0);
+
+	return queue->length;
+}
+
+void
+gs_key_queue_forward (GSKeyQueue *queue,
+		      GtkWindow  *window)
+{
+	GdkWindow *gdk_window;
+	GdkSeat   *seat;
+	GdkEvent  *event;
+	char       string[8];
+	guint      n;
+
+	g_return_if_fail (queue != NULL);
+	g_return_if_fail (GTK_IS_WINDOW (window));
+
+	gdk_window = gtk_widget_get_window (GTK_WIDGET (window));
+	if (queue->length == 0 || gdk_window == NULL) {
+		return;
+	}
+
+	/* one event is filled in from each record in turn */
+	event = gdk_event_new (GDK_KEY_PRESS);
+	event->key.window = g_object_ref (gdk_window);
+	event->key.send_event = TRUE;
+
+	seat = gdk_display_get_default_seat (gdk_window_get_display (gdk_window));
+	gdk_event_set_device (event, gdk_seat_get_keyboard (seat));
+
+	/* forwarding may queue keys again, so only replay what is here now */
+	for (n = queue->length; n > 0; n--) {
+		GSKeyRecord *record;
+		gunichar     c;
+		int          len;
+
+		record = &queue->records[queue->head];
+
+		c = gdk_keyval_to_unicode (record->keyval);
+		len = (c != 0 && ! g_unichar_iscntrl (c)) ? g_unichar_to_utf8 (c, string) : 0;
+		string[len] = '\0';
+
+		event->key.time = record->time;
+		event->key.state = record->state;
+		event->key.keyval = record->keyval;
+		event->key.hardware_keycode = record->hardware_keycode;
+		event->key.group = record->group;
+		event->key.is_modifier = record->is_modifier;
+		event->key.string = string;
+		event->key.length = len;
+
+		memset (record, 0, sizeof (GSKeyRecord));
+		queue->head = (queue->head + 1) & (GS_KEY_QUEUE_SIZE - 1);
+		queue->length--;
+
+		gtk_window_propagate_key_event (window, &event->key);
+	}
+
+	memset (string, 0, sizeof (string));
+	event->key.string = NULL;
+	gdk_event_free (event);
+}
+
+void
+gs_key_queue_clear (GSKeyQueue *queue)
+{
+	g_return_if_fail (queue != NULL);
+
+	memset (queue, 0, sizeof (GSKeyQueue));
+}
@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_KEY_QUEUE_H
+#define __GS_KEY_QUEUE_H
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* must be a power of two */
+#define GS_KEY_QUEUE_SIZE 256
+
+typedef struct {
+	guint32 time;
+	guint32 state;
+	guint32 keyval;
+	guint16 hardware_keycode;
+	guint8 group;
+	guint8 is_modifier;
+} GSKeyRecord;
+
+typedef struct {
+	GSKeyRecord records[GS_KEY_QUEUE_SIZE];
+	guint head;
+	guint length;
+} GSKeyQueue;
+
+gboolean gs_key_queue_push(GSKeyQueue* queue, const GdkEventKey* event);
+guint gs_key_queue_get_length(GSKeyQueue* queue);
+void gs_key_queue_forward(GSKeyQueue* queue, GtkWindow* window);
+void gs_key_queue_clear(GSKeyQueue* queue);
+
+G_END_DECLS
+
+#endif /* __GS_KEY_QUEUE_H */
@@ -23,62 +23,136 @@
 #include "config.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <time.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <glib/gi18n.h>
+#include <gio/gio.h>
 #include <gtk/gtk.h>
 
-#include <dbus/dbus.h>
-#include <dbus/dbus-glib.h>
-#include <dbus/dbus-glib-lowlevel.h>
-
 #ifdef WITH_SYSTEMD
+#include <gio/gunixfdlist.h>
 #include <systemd/sd-login.h>
 #endif
 
 #include "gs-listener-dbus.h"
 #include "gs-marshal.h"
+#include "gs-stats.h"
+#include "gs-clock.h"
 #include "gs-debug.h"
 #include "gs-bus.h"
+#include "gs-bus-watch.h"
 
 static void              gs_listener_class_init         (GSListenerClass *klass);
 static void              gs_listener_init               (GSListener      *listener);
 static void              gs_listener_finalize           (GObject         *object);
 
-static void              gs_listener_unregister_handler (DBusConnection  *connection,
-							 void            *data);
-
-static DBusHandlerResult gs_listener_message_handler    (DBusConnection  *connection,
-							 DBusMessage     *message,
-							 void            *user_data);
+static void              listener_dbus_handle_method_call (GDBusConnection       *connection,
+							   const char            *sender,
+							   const char            *object_path,
+							   const char            *interface_name,
+							   const char            *method_name,
+							   GVariant              *parameters,
+							   GDBusMethodInvocation *invocation,
+							   gpointer               user_data);
+static GVariant         *listener_dbus_handle_get_property (GDBusConnection  *connection,
+							    const char       *sender,
+							    const char       *object_path,
+							    const char       *interface_name,
+							    const char       *property_name,
+							    GError          **error,
+							    gpointer          user_data);
 
 #define TYPE_MISMATCH_ERROR  GS_INTERFACE ".TypeMismatch"
+#define GENERAL_ERROR        GS_INTERFACE ".GeneralError"
+
+/* slots in system_subscriptions */
+enum {
+	SYSTEM_SIGNAL_SLEEP,
+	SYSTEM_SIGNAL_LOCK,
+	SYSTEM_SIGNAL_UNLOCK,
+	SYSTEM_SIGNAL_ACTIVE,
+	N_SYSTEM_SUBSCRIPTIONS
+};
+
+/* logind's own default for InhibitDelayMaxSec, in microseconds */
+#define DEFAULT_INHIBIT_DELAY_MAX 5000000
+
+/* how long before logind stops waiting we give up ourselves, in ms */
+#define SLEEP_LOCK_MARGIN 500
+
+/* ActiveChanged flips closer together than this are sent as one */
+#define ACTIVE_CHANGED_WINDOW 250
 
 struct _GSListenerPrivate
 {
-	DBusConnection *connection;
-	DBusConnection *system_connection;
-
+	GDBusConnection *connection;
+	GDBusConnection *system_connection;
+	GCancellable    *cancellable;
+	guint           session_watch_id;
+	guint           system_watch_id;
+
+	guint           registration_id;
+	guint           stats_registration_id;
+	guint           name_id;
+	guint           system_subscriptions [N_SYSTEM_SUBSCRIPTIONS];
+	guint           system_filter_id;
+	gint            system_received;
+	guint           system_handled;
+
+	guint           acquired : 1;
+	guint           name_acquired : 1;
 	guint           session_idle : 1;
 	guint           active : 1;
 	guint           activation_enabled : 1;
-	time_t          active_start;
-	time_t          session_idle_start;
+	guint           lock_active : 1;
+	gint64          active_start;
+	gint64          active_since;
+	gint64          session_idle_start;
+	gint64          activate_requested;
+
+	guint           emitted_active : 1;
+	guint           active_changed_id;
+	guint           active_changed_pending;
+	gint64          active_changed_time;
 	char           *session_id;
+	char           *session_path;
+
+	GHashTable     *inhibitors;
+	GHashTable     *clients;
+	guint           n_inhibitors;
+	guint           n_throttlers;
+	guint           name_owner_id;
 
 #ifdef WITH_SYSTEMD
 	gboolean        have_systemd;
+
+	int             sleep_inhibit_fd;
+	guint           sleep_inhibit_pending : 1;
+	guint64         inhibit_delay_max;
+	gint64          sleep_start;
+	guint           sleep_timeout_id;
 #endif
 };
 
+/* An Inhibit() or Throttle() call, held until it is undone or the
+ * client leaves the bus */
+typedef struct
+{
+	guint32  cookie;
+	char    *sender;
+	char    *application;
+	char    *reason;
+	gboolean throttle;
+} GSListenerRefEntry;
+
 enum {
 	LOCK,
 	CONFIG_LOCK,
 	QUIT,
 	SIMULATE_USER_ACTIVITY,
 	ACTIVE_CHANGED,
+	THROTTLE_CHANGED,
 	SHOW_MESSAGE,
 	LAST_SIGNAL
 };
@@ -90,13 +164,89 @@ enum {
 	PROP_ACTIVATION_ENABLED,
 };
 
-static DBusObjectPathVTable
-gs_listener_vtable = { &gs_listener_unregister_handler,
-		       &gs_listener_message_handler,
-		       NULL,
+static const char introspection_xml[] =
+	"<node>\n"
+	"  <interface name=\""GS_INTERFACE"\">\n"
+	"    <method name=\"Lock\">\n"
+	"    </method>\n"
+	"    <method name=\"Quit\">\n"
+	"    </method>\n"
+	"    <method name=\"Cycle\">\n"
+	"    </method>\n"
+	"    <method name=\"Inhibit\">\n"
+	"      <arg name=\"application_name\" direction=\"in\" type=\"s\"/>\n"
+	"      <arg name=\"reason\" direction=\"in\" type=\"s\"/>\n"
+	"      <arg name=\"cookie\" direction=\"out\" type=\"u\"/>\n"
+	"    </method>\n"
+	"    <method name=\"UnInhibit\">\n"
+	"      <arg name=\"cookie\" direction=\"in\" type=\"u\"/>\n"
+	"    </method>\n"
+	"    <method name=\"Throttle\">\n"
+	"      <arg name=\"application_name\" direction=\"in\" type=\"s\"/>\n"
+	"      <arg name=\"reason\" direction=\"in\" type=\"s\"/>\n"
+	"      <arg name=\"cookie\" direction=\"out\" type=\"u\"/>\n"
+	"    </method>\n"
+	"    <method name=\"UnThrottle\">\n"
+	"      <arg name=\"cookie\" direction=\"in\" type=\"u\"/>\n"
+	"    </method>\n"
+	"    <method name=\"SimulateUserActivity\">\n"
+	"    </method>\n"
+	"    <method name=\"GetActive\">\n"
+	"      <arg name=\"value\" direction=\"out\" type=\"b\"/>\n"
+	"    </method>\n"
+	"    <method name=\"GetActiveTime\">\n"
+	"      <arg name=\"seconds\" direction=\"out\" type=\"u\"/>\n"
+	"    </method>\n"
+	"    <method name=\"GetActiveDuration\">\n"
+	"      <arg name=\"with_suspend\" direction=\"out\" type=\"t\"/>\n"
+	"      <arg name=\"without_suspend\" direction=\"out\" type=\"t\"/>\n"
+	"    </method>\n"
+	"    <method name=\"GetStats\">\n"
+	"      <arg name=\"stats\" direction=\"out\" type=\"a(suxxx)\"/>\n"
+	"    </method>\n"
+	"    <method name=\"SetActive\">\n"
+	"      <arg name=\"value\" direction=\"in\" type=\"b\"/>\n"
+	"    </method>\n"
+	"    <method name=\"ShowMessage\">\n"
+	"      <arg name=\"summary\" direction=\"in\" type=\"s\"/>\n"
+	"      <arg name=\"body\" direction=\"in\" type=\"s\"/>\n"
+	"      <arg name=\"icon\" direction=\"in\" type=\"s\"/>\n"
+	"    </method>\n"
+	"    <method name=\"GetState\">\n"
+	"      <arg name=\"active\" direction=\"out\" type=\"b\"/>\n"
+	"      <arg name=\"active_since\" direction=\"out\" type=\"x\"/>\n"
+	"      <arg name=\"lock_active\" direction=\"out\" type=\"b\"/>\n"
+	"      <arg name=\"inhibited\" direction=\"out\" type=\"b\"/>\n"
+	"    </method>\n"
+	"    <signal name=\"ActiveChanged\">\n"
+	"      <arg name=\"new_value\" type=\"b\"/>\n"
+	"    </signal>\n"
+	"    <property name=\"Active\" type=\"b\" access=\"read\"/>\n"
+	"    <property name=\"ActiveSince\" type=\"x\" access=\"read\"/>\n"
+	"    <property name=\"LockActive\" type=\"b\" access=\"read\"/>\n"
+	"    <property name=\"Inhibited\" type=\"b\" access=\"read\"/>\n"
+	"  </interface>\n"
+	"  <interface name=\""GS_STATS_INTERFACE"\">\n"
+	"    <annotation name=\"org.freedesktop.DBus.Property.EmitsChangedSignal\" value=\"false\"/>\n"
+	"    <property name=\"ActivationCount\" type=\"u\" access=\"read\"/>\n"
+	"    <property name=\"ActivationLatency\" type=\"x\" access=\"read\"/>\n"
+	"    <property name=\"ActivationLatencyP50\" type=\"x\" access=\"read\"/>\n"
+	"    <property name=\"ActivationLatencyP95\" type=\"x\" access=\"read\"/>\n"
+	"    <property name=\"DialogSpawnLatency\" type=\"x\" access=\"read\"/>\n"
+	"    <property name=\"AuthLatency\" type=\"x\" access=\"read\"/>\n"
+	"    <property name=\"GrabRetries\" type=\"u\" access=\"read\"/>\n"
+	"    <property name=\"FadeDuration\" type=\"x\" access=\"read\"/>\n"
+	"    <property name=\"ResidentSetSize\" type=\"t\" access=\"read\"/>\n"
+	"  </interface>\n"
+	"</node>\n";
+
+static const GDBusInterfaceVTable
+gs_listener_vtable = { listener_dbus_handle_method_call,
+		       listener_dbus_handle_get_property,
 		       NULL,
-		       NULL,
-		       NULL };
+		       { NULL } };
+
+static GDBusNodeInfo *introspection_data = NULL;
 
 static guint         signals [LAST_SIGNAL] = { 0, };
 
@@ -114,71 +264,207 @@ gs_listener_error_quark (void)
 }
 
 static void
-gs_listener_unregister_handler (DBusConnection *connection,
-				void           *data)
+send_dbus_boolean_signal (GSListener *listener,
+			  const char *name,
+			  gboolean    value)
 {
-	(void) connection;
-	(void) data;
+	GError *error;
+
+	g_return_if_fail (listener != NULL);
+
+	if (listener->priv->connection == NULL) {
+		gs_debug ("There is no valid connection to the message bus");
+		return;
+	}
+
+	error = NULL;
+	if (! g_dbus_connection_emit_signal (listener->priv->connection,
+					     NULL,
+					     GS_PATH,
+					     GS_INTERFACE,
+					     name,
+					     g_variant_new ("(b)", value),
+					     &error)) {
+		gs_debug ("Could not send %s signal: %s", name, error->message);
+		g_error_free (error);
+	}
 }
 
 static gboolean
-send_dbus_message (DBusConnection *connection,
-		   DBusMessage    *message)
+listener_is_inhibited (GSListener *listener)
 {
-	gboolean is_connected;
-	gboolean sent;
+	return ! listener->priv->activation_enabled || listener->priv->n_inhibitors > 0;
+}
 
-	g_return_val_if_fail (message != NULL, FALSE);
+/* Values of the read-only D-Bus properties; ActiveSince is in
+ * g_get_monotonic_time() units and zero while inactive */
+static GVariant *
+listener_get_state_property (GSListener *listener,
+			     const char *name)
+{
+	if (strcmp (name, "Active") == 0) {
+		return g_variant_new_boolean (listener->priv->active);
+	} else if (strcmp (name, "ActiveSince") == 0) {
+		return g_variant_new_int64 (listener->priv->active_since);
+	} else if (strcmp (name, "LockActive") == 0) {
+		return g_variant_new_boolean (listener->priv->lock_active);
+	} else if (strcmp (name, "Inhibited") == 0) {
+		return g_variant_new_boolean (listener_is_inhibited (listener));
+	}
 
-	if (! connection) {
-		gs_debug ("There is no valid connection to the message bus");
-		return FALSE;
+	return NULL;
+}
+
+static guint32
+stats_count (const char *name)
+{
+	const GSStatsEntry *entry;
+
+	entry = gs_stats_lookup (name);
+
+	return entry != NULL ? entry->count : 0;
+}
+
+static gint64
+stats_last (const char *name)
+{
+	const GSStatsEntry *entry;
+
+	entry = gs_stats_lookup (name);
+
+	return entry != NULL ? entry->last : 0;
+}
+
+/* The Stats interface reads straight from gs-stats, durations are
+ * in microseconds and the latest sample unless marked otherwise */
+static GVariant *
+listener_get_stats_property (const char *name)
+{
+	if (strcmp (name, "ActivationCount") == 0) {
+		return g_variant_new_uint32 (stats_count ("activation"));
+	} else if (strcmp (name, "ActivationLatency") == 0) {
+		return g_variant_new_int64 (stats_last ("activation"));
+	} else if (strcmp (name, "ActivationLatencyP50") == 0) {
+		return g_variant_new_int64 (gs_stats_percentile ("activation", 50));
+	} else if (strcmp (name, "ActivationLatencyP95") == 0) {
+		return g_variant_new_int64 (gs_stats_percentile ("activation", 95));
+	} else if (strcmp (name, "DialogSpawnLatency") == 0) {
+		return g_variant_new_int64 (stats_last ("dialog-spawn"));
+	} else if (strcmp (name, "AuthLatency") == 0) {
+		return g_variant_new_int64 (stats_last ("auth-authenticate"));
+	} else if (strcmp (name, "GrabRetries") == 0) {
+		return g_variant_new_uint32 (stats_count ("grab-retries"));
+	} else if (strcmp (name, "FadeDuration") == 0) {
+		return g_variant_new_int64 (stats_last ("fade"));
+	} else if (strcmp (name, "ResidentSetSize") == 0) {
+		return g_variant_new_uint64 (gs_stats_get_rss ());
 	}
 
-	is_connected = dbus_connection_get_is_connected (connection);
-	if (! is_connected) {
-		gs_debug ("Not connected to the message bus");
-		return FALSE;
+	return NULL;
+}
+
+static void
+listener_emit_properties_changed (GSListener *listener,
+				  const char *first_property,
+				  ...)
+{
+	GVariantBuilder changed;
+	const char     *name;
+	va_list         args;
+	GError         *error;
+
+	if (listener->priv->connection == NULL) {
+		return;
 	}
 
-	sent = dbus_connection_send (connection, message, NULL);
+	g_variant_builder_init (&changed, G_VARIANT_TYPE_VARDICT);
+
+	va_start (args, first_property);
+	for (name = first_property; name != NULL; name = va_arg (args, const char *)) {
+		g_variant_builder_add (&changed, "{sv}",
+				       name,
+				       listener_get_state_property (listener, name));
+	}
+	va_end (args);
 
-	return sent;
+	error = NULL;
+	if (! g_dbus_connection_emit_signal (listener->priv->connection,
+					     NULL,
+					     GS_PATH,
+					     "org.freedesktop.DBus.Properties",
+					     "PropertiesChanged",
+					     g_variant_new ("(sa{sv}@as)",
+							    GS_INTERFACE,
+							    &changed,
+							    g_variant_new_strv (NULL, 0)),
+					     &error)) {
+		gs_debug ("Could not send PropertiesChanged signal: %s", error->message);
+		g_error_free (error);
+	}
 }
 
 static void
-send_dbus_boolean_signal (GSListener *listener,
-			  const char *name,
-			  gboolean    value)
+listener_emit_active_changed (GSListener *listener)
 {
-	DBusMessage    *message;
-	DBusMessageIter iter;
+	gs_debug ("Sending the ActiveChanged(%s) signal on the session bus",
+		  listener->priv->active ? "TRUE" : "FALSE");
 
-	g_return_if_fail (listener != NULL);
+	listener->priv->emitted_active = listener->priv->active;
+	listener->priv->active_changed_time = g_get_monotonic_time ();
+
+	send_dbus_boolean_signal (listener, "ActiveChanged", listener->priv->active);
+	listener_emit_properties_changed (listener, "Active", "ActiveSince", NULL);
+
+	gs_stats_count ("active-changed-emitted", 1);
+}
 
-	message = dbus_message_new_signal (GS_PATH,
-					   GS_SERVICE,
-					   name);
+static gboolean
+active_changed_timeout (GSListener *listener)
+{
+	guint suppressed;
 
-	dbus_message_iter_init_append (message, &iter);
-	dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &value);
+	listener->priv->active_changed_id = 0;
 
-	if (! send_dbus_message (listener->priv->connection, message)) {
-		gs_debug ("Could not send %s signal", name);
+	/* only the state we settled on goes out, and nothing at all
+	 * if we flipped back to what subscribers already have */
+	suppressed = listener->priv->active_changed_pending;
+	if (listener->priv->active != listener->priv->emitted_active) {
+		listener_emit_active_changed (listener);
+		suppressed--;
 	}
 
-	dbus_message_unref (message);
+	gs_debug ("Coalesced %u ActiveChanged signals", suppressed);
+	gs_stats_count ("active-changed-suppressed", suppressed);
+
+	listener->priv->active_changed_pending = 0;
+
+	return FALSE;
 }
 
 static void
 gs_listener_send_signal_active_changed (GSListener *listener)
 {
+	gint64 elapsed;
+
 	g_return_if_fail (listener != NULL);
 
-	gs_debug ("Sending the ActiveChanged(%s) signal on the session bus",
-		  listener->priv->active ? "TRUE" : "FALSE");
+	if (listener->priv->active_changed_id > 0) {
+		listener->priv->active_changed_pending++;
+		return;
+	}
 
-	send_dbus_boolean_signal (listener, "ActiveChanged", listener->priv->active);
+	/* Send the first change straight away; anything following it
+	 * within the window waits for the window to close */
+	elapsed = g_get_monotonic_time () - listener->priv->active_changed_time;
+	if (elapsed >= ACTIVE_CHANGED_WINDOW * 1000) {
+		listener_emit_active_changed (listener);
+		return;
+	}
+
+	listener->priv->active_changed_pending = 1;
+	listener->priv->active_changed_id = g_timeout_add (ACTIVE_CHANGED_WINDOW - elapsed / 1000,
+							   (GSourceFunc) active_changed_timeout,
+							   listener);
 }
 
 static gboolean
@@ -188,7 +474,9 @@ listener_check_activation (GSListener *listener)
 
 	gs_debug ("Checking for activation");
 
-	if (! listener->priv->activation_enabled) {
+	/* an application holding an inhibitor is the same as
+	 * activation being disabled, no lookup needed */
+	if (listener_is_inhibited (listener)) {
 		return TRUE;
 	}
 
@@ -209,7 +497,7 @@ listener_set_session_idle_internal (GSListener *listener,
 	listener->priv->session_idle = idle;
 
 	if (idle) {
-		listener->priv->session_idle_start = time (NULL);
+		listener->priv->session_idle_start = gs_clock_get_boottime ();
 	} else {
 		listener->priv->session_idle_start = 0;
 	}
@@ -229,9 +517,11 @@ listener_set_active_internal (GSListener *listener,
 	}
 
 	if (active) {
-		listener->priv->active_start = time (NULL);
+		listener->priv->active_start = gs_clock_get_boottime ();
+		listener->priv->active_since = g_get_monotonic_time ();
 	} else {
 		listener->priv->active_start = 0;
+		listener->priv->active_since = 0;
 	}
 
 	gs_listener_send_signal_active_changed (listener);
@@ -253,9 +543,16 @@ gs_listener_set_active (GSListener *listener,
 		return FALSE;
 	}
 
+	/* the windows are up and grabbed when gs_listener_activation_finished() is called */
+	if (active) {
+		listener->priv->activate_requested = g_get_monotonic_time ();
+	}
+
 	res = FALSE;
 	g_signal_emit (listener, signals [ACTIVE_CHANGED], 0, active, &res);
 	if (! res) {
+		listener->priv->activate_requested = 0;
+
 		/* if the signal is not handled then we haven't changed state */
 		gs_debug ("Active-changed signal not handled");
 
@@ -269,6 +566,11 @@ gs_listener_set_active (GSListener *listener,
 
 	listener_set_active_internal (listener, active);
 
+	/* an activation that never finished is over too */
+	if (! active) {
+		listener->priv->activate_requested = 0;
+	}
+
 	return TRUE;
 }
 
@@ -314,19 +616,38 @@ void
 gs_listener_set_activation_enabled (GSListener *listener,
 				    gboolean    enabled)
 {
+	gboolean was_inhibited;
+
 	g_return_if_fail (GS_IS_LISTENER (listener));
 
 	if (listener->priv->activation_enabled != enabled) {
+		was_inhibited = listener_is_inhibited (listener);
 		listener->priv->activation_enabled = enabled;
+
+		if (listener_is_inhibited (listener) != was_inhibited) {
+			listener_emit_properties_changed (listener, "Inhibited", NULL);
+		}
+	}
+}
+
+void
+gs_listener_set_lock_active (GSListener *listener,
+			     gboolean    lock_active)
+{
+	g_return_if_fail (GS_IS_LISTENER (listener));
+
+	if (listener->priv->lock_active != lock_active) {
+		listener->priv->lock_active = lock_active;
+		listener_emit_properties_changed (listener, "LockActive", NULL);
 	}
 }
 
-static dbus_bool_t
+static gboolean
 listener_property_set_bool (GSListener *listener,
 			    guint       prop_id,
-			    dbus_bool_t value)
+			    gboolean    value)
 {
-	dbus_bool_t ret;
+	gboolean ret;
 
 	ret = FALSE;
 
@@ -343,803 +664,1144 @@ listener_property_set_bool (GSListener *listener,
 }
 
 static void
-raise_error (DBusConnection *connection,
-	     DBusMessage    *in_reply_to,
-	     const char     *error_name,
-	     char           *format, ...)
+raise_error (GDBusMethodInvocation *invocation,
+	     const char            *error_name,
+	     const char            *format, ...)
 {
-	char         buf[512];
-	DBusMessage *reply;
-
+	char    buf[512];
 	va_list args;
+
 	va_start (args, format);
 	vsnprintf (buf, sizeof (buf), format, args);
 	va_end (args);
 
-	gs_debug (buf);
-	reply = dbus_message_new_error (in_reply_to, error_name, buf);
-	if (reply == NULL) {
-		g_error ("No memory");
-	}
-	if (! dbus_connection_send (connection, reply, NULL)) {
-		g_error ("No memory");
-	}
-
-	dbus_message_unref (reply);
+	gs_debug ("%s", buf);
+	g_dbus_method_invocation_return_dbus_error (invocation, error_name, buf);
 }
 
 static void
-raise_syntax (DBusConnection *connection,
-	      DBusMessage    *in_reply_to,
-	      const char     *method_name)
+raise_property_type_error (GDBusMethodInvocation *invocation,
+			   const char            *device_id)
 {
-	raise_error (connection, in_reply_to,
-		     GS_SERVICE ".SyntaxError",
-		     "There is a syntax error in the invocation of the method %s",
-		     method_name);
+	raise_error (invocation,
+		     TYPE_MISMATCH_ERROR,
+		     "Type mismatch setting property with id %s",
+		     device_id);
 }
 
 static void
-raise_property_type_error (DBusConnection *connection,
-			   DBusMessage    *in_reply_to,
-			   const char     *device_id)
+listener_set_property (GSListener            *listener,
+		       GDBusMethodInvocation *invocation,
+		       GVariant              *parameters,
+		       guint                  prop_id)
 {
-	char         buf [512];
-	DBusMessage *reply;
+	gboolean rc;
 
-	snprintf (buf, 511,
-		  "Type mismatch setting property with id %s",
-		  device_id);
-	gs_debug (buf);
+	rc = FALSE;
 
-	reply = dbus_message_new_error (in_reply_to,
-					TYPE_MISMATCH_ERROR,
-					buf);
-	if (reply == NULL) {
-		g_error ("No memory");
+	if (g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)"))) {
+		gboolean v;
+
+		g_variant_get (parameters, "(b)", &v);
+		rc = listener_property_set_bool (listener, prop_id, v);
+	} else {
+		gs_debug ("Unsupported property type %s",
+			  g_variant_get_type_string (parameters));
 	}
-	if (! dbus_connection_send (connection, reply, NULL)) {
-		g_error ("No memory");
+
+	if (! rc) {
+		raise_property_type_error (invocation,
+					   g_dbus_method_invocation_get_object_path (invocation));
+		return;
 	}
 
-	dbus_message_unref (reply);
+	g_dbus_method_invocation_return_value (invocation, NULL);
 }
 
-static DBusHandlerResult
-listener_set_property (GSListener     *listener,
-		       DBusConnection *connection,
-		       DBusMessage    *message,
-		       guint           prop_id)
+static void
+listener_get_property (GSListener            *listener,
+		       GDBusMethodInvocation *invocation,
+		       guint                  prop_id)
 {
-	const char     *path;
-	int             type;
-	gboolean        rc;
-	DBusMessageIter iter;
-	DBusMessage    *reply;
-
-	path = dbus_message_get_path (message);
-
-	dbus_message_iter_init (message, &iter);
-	type = dbus_message_iter_get_arg_type (&iter);
-	rc = FALSE;
-
-	switch (type) {
-	case DBUS_TYPE_BOOLEAN:
-		{
-			dbus_bool_t v;
-			dbus_message_iter_get_basic (&iter, &v);
-			rc = listener_property_set_bool (listener, prop_id, v);
-			break;
-		}
+	switch (prop_id) {
+	case PROP_ACTIVE:
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(b)", listener->priv->active));
+		break;
 	default:
-		gs_debug ("Unsupported property type %d", type);
+		gs_debug ("Unsupported property id %u", prop_id);
+		g_dbus_method_invocation_return_value (invocation, NULL);
 		break;
 	}
+}
 
-	if (! rc) {
-		raise_property_type_error (connection, message, path);
-		return DBUS_HANDLER_RESULT_HANDLED;
-	}
-
-	reply = dbus_message_new_method_return (message);
+/* The boot time clock gives the duration including any time spent
+ * suspended, the monotonic one the time the screen was actually up */
+static void
+listener_get_active_durations (GSListener *listener,
+			       guint64    *with_suspend,
+			       guint64    *without_suspend)
+{
+	*with_suspend = 0;
+	*without_suspend = 0;
 
-	if (reply == NULL) {
-		g_error ("No memory");
+	if (! listener->priv->active) {
+		return;
 	}
 
-	if (! dbus_connection_send (connection, reply, NULL)) {
-		g_error ("No memory");
+	if (listener->priv->active_start <= 0 || listener->priv->active_since <= 0) {
+		/* shouldn't happen */
+		gs_debug ("Active start time was not set");
+		return;
 	}
 
-	dbus_message_unref (reply);
-
-	return DBUS_HANDLER_RESULT_HANDLED;
+	*with_suspend = gs_clock_get_boottime () - listener->priv->active_start;
+	*without_suspend = g_get_monotonic_time () - listener->priv->active_since;
 }
 
-static DBusHandlerResult
-listener_get_property (GSListener     *listener,
-		       DBusConnection *connection,
-		       DBusMessage    *message,
-		       guint           prop_id)
+static void
+listener_get_active_time (GSListener            *listener,
+			  GDBusMethodInvocation *invocation,
+			  GVariant              *parameters)
 {
-	DBusMessageIter iter;
-	DBusMessage    *reply;
+	(void) parameters;
 
-	reply = dbus_message_new_method_return (message);
+	guint64 with_suspend;
+	guint64 without_suspend;
+	guint32 secs;
 
-	dbus_message_iter_init_append (reply, &iter);
+	listener_get_active_durations (listener, &with_suspend, &without_suspend);
+	secs = with_suspend / G_USEC_PER_SEC;
 
-	if (reply == NULL)
-		g_error ("No memory");
+	gs_debug ("Returning screensaver active for %u seconds", secs);
+	g_dbus_method_invocation_return_value (invocation, g_variant_new ("(u)", secs));
+}
 
-	switch (prop_id) {
-	case PROP_ACTIVE:
-		{
-			dbus_bool_t b;
-			b = listener->priv->active;
-			dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &b);
-		}
-		break;
-	default:
-		gs_debug ("Unsupported property id %u", prop_id);
-		break;
-	}
+static void
+listener_get_active_duration (GSListener            *listener,
+			      GDBusMethodInvocation *invocation,
+			      GVariant              *parameters)
+{
+	(void) parameters;
 
-	if (! dbus_connection_send (connection, reply, NULL)) {
-		g_error ("No memory");
-	}
+	guint64 with_suspend;
+	guint64 without_suspend;
+
+	listener_get_active_durations (listener, &with_suspend, &without_suspend);
 
-	dbus_message_unref (reply);
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new ("(tt)", with_suspend, without_suspend));
+}
 
-	return DBUS_HANDLER_RESULT_HANDLED;
+static void
+append_stats_entry (const char         *name,
+		    const GSStatsEntry *entry,
+		    GVariantBuilder    *array)
+{
+	g_variant_builder_add (array, "(suxxx)",
+			       name,
+			       (guint32) entry->count,
+			       (gint64) entry->total,
+			       (gint64) entry->max,
+			       (gint64) entry->last);
 }
 
-static DBusHandlerResult
-listener_get_active_time (GSListener     *listener,
-			  DBusConnection *connection,
-			  DBusMessage    *message)
+static void
+listener_get_stats (GSListener            *listener,
+		    GDBusMethodInvocation *invocation,
+		    GVariant              *parameters)
 {
-	DBusMessageIter iter;
-	DBusMessage    *reply;
-	dbus_uint32_t    secs;
+	(void) parameters;
 
-	reply = dbus_message_new_method_return (message);
+	GVariantBuilder array;
+	GSStatsEntry    entry;
 
-	dbus_message_iter_init_append (reply, &iter);
+	g_variant_builder_init (&array, G_VARIANT_TYPE ("a(suxxx)"));
+	gs_stats_foreach ((GSStatsFunc) append_stats_entry, &array);
 
-	if (reply == NULL) {
-		g_error ("No memory");
-	}
+	memset (&entry, 0, sizeof (entry));
+	entry.count = g_atomic_int_get (&listener->priv->system_received);
+	append_stats_entry ("system-bus-received", &entry, &array);
+	entry.count = listener->priv->system_handled;
+	append_stats_entry ("system-bus-handled", &entry, &array);
+
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new ("(a(suxxx))", &array));
+}
 
+static void
+listener_show_message (GSListener            *listener,
+		       GDBusMethodInvocation *invocation,
+		       GVariant              *parameters)
+{
+	/* if we're not active we ignore the request */
 	if (listener->priv->active) {
-		time_t now = time (NULL);
-
-		if (now < listener->priv->active_start) {
-			/* shouldn't happen */
-			gs_debug ("Active start time is in the future");
-			secs = 0;
-		} else if (listener->priv->active_start <= 0) {
-			/* shouldn't happen */
-			gs_debug ("Active start time was not set");
-			secs = 0;
-		} else {
-			secs = now - listener->priv->active_start;
-		}
-	} else {
-		secs = 0;
-	}
+		const char *summary;
+		const char *body;
+		const char *icon;
 
-	gs_debug ("Returning screensaver active for %u seconds", secs);
-	dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &secs);
+		g_variant_get (parameters, "(&s&s&s)", &summary, &body, &icon);
 
-	if (! dbus_connection_send (connection, reply, NULL)) {
-		g_error ("No memory");
+		g_signal_emit (listener, signals [SHOW_MESSAGE], 0, summary, body, icon);
 	}
 
-	dbus_message_unref (reply);
+	g_dbus_method_invocation_return_value (invocation, NULL);
+}
 
-	return DBUS_HANDLER_RESULT_HANDLED;
+static void
+send_success_reply (GDBusMethodInvocation *invocation)
+{
+	g_dbus_method_invocation_return_value (invocation, NULL);
 }
 
-static DBusHandlerResult
-listener_show_message (GSListener     *listener,
-		       DBusConnection *connection,
-		       DBusMessage    *message)
+static void
+listener_lock (GSListener            *listener,
+	       GDBusMethodInvocation *invocation,
+	       GVariant              *parameters)
 {
-	DBusMessageIter iter;
-	DBusMessage    *reply;
-	DBusError       error;
+	(void) parameters;
 
-	reply = dbus_message_new_method_return (message);
+	g_signal_emit (listener, signals [LOCK], 0);
+	send_success_reply (invocation);
+}
 
-	dbus_message_iter_init_append (reply, &iter);
+static void
+listener_quit (GSListener            *listener,
+	       GDBusMethodInvocation *invocation,
+	       GVariant              *parameters)
+{
+	(void) parameters;
 
-	if (reply == NULL) {
-		g_error ("No memory");
-	}
+	g_signal_emit (listener, signals [QUIT], 0);
+	send_success_reply (invocation);
+}
 
-	if (listener->priv->active) {
-		char *summary;
-		char *body;
-		char *icon;
-
-		/* if we're not active we ignore the request */
-
-		dbus_error_init (&error);
-		if (! dbus_message_get_args (message, &error,
-					     DBUS_TYPE_STRING, &summary,
-					     DBUS_TYPE_STRING, &body,
-					     DBUS_TYPE_STRING, &icon,
-					     DBUS_TYPE_INVALID)) {
-			raise_syntax (connection, message, "ShowMessage");
-			return DBUS_HANDLER_RESULT_HANDLED;
-		}
+static void
+listener_simulate_user_activity (GSListener            *listener,
+				 GDBusMethodInvocation *invocation,
+				 GVariant              *parameters)
+{
+	(void) parameters;
 
-		g_signal_emit (listener, signals [SHOW_MESSAGE], 0, summary, body, icon);
-	}
+	g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
+	send_success_reply (invocation);
+}
 
-	if (! dbus_connection_send (connection, reply, NULL)) {
-		g_error ("No memory");
-	}
-
-	dbus_message_unref (reply);
-
-	return DBUS_HANDLER_RESULT_HANDLED;
-}
-
-static DBusHandlerResult
-do_introspect (DBusConnection *connection,
-	       DBusMessage    *message,
-	       dbus_bool_t     local_interface)
-{
-	(void) local_interface;
-
-	DBusMessage *reply;
-	GString     *xml;
-	char        *xml_string;
-
-	/* standard header */
-	xml = g_string_new ("<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n"
-			    "\"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n"
-			    "<node>\n"
-			    "  <interface name=\"org.freedesktop.DBus.Introspectable\">\n"
-			    "    <method name=\"Introspect\">\n"
-			    "      <arg name=\"data\" direction=\"out\" type=\"s\"/>\n"
-			    "    </method>\n"
-			    "  </interface>\n");
-
-	/* ScreenSaver interface */
-	xml = g_string_append (xml,
-			       "  <interface name=\""GS_INTERFACE"\">\n"
-			       "    <method name=\"Lock\">\n"
-			       "    </method>\n"
-			       "    <method name=\"SimulateUserActivity\">\n"
-			       "    </method>\n"
-			       "    <method name=\"GetActive\">\n"
-			       "      <arg name=\"value\" direction=\"out\" type=\"b\"/>\n"
-			       "    </method>\n"
-			       "    <method name=\"GetActiveTime\">\n"
-			       "      <arg name=\"seconds\" direction=\"out\" type=\"u\"/>\n"
-			       "    </method>\n"
-			       "    <method name=\"SetActive\">\n"
-			       "      <arg name=\"value\" direction=\"in\" type=\"b\"/>\n"
-			       "    </method>\n"
-			       "    <method name=\"ShowMessage\">\n"
-			       "      <arg name=\"summary\" direction=\"in\" type=\"s\"/>\n"
-			       "      <arg name=\"body\" direction=\"in\" type=\"s\"/>\n"
-			       "      <arg name=\"icon\" direction=\"in\" type=\"s\"/>\n"
-			       "    </method>\n"
-			       "    <signal name=\"ActiveChanged\">\n"
-			       "      <arg name=\"new_value\" type=\"b\"/>\n"
-			       "    </signal>\n"
-			       "  </interface>\n");
-
-	reply = dbus_message_new_method_return (message);
-
-	xml = g_string_append (xml, "</node>\n");
-	xml_string = g_string_free (xml, FALSE);
-
-	dbus_message_append_args (reply,
-				  DBUS_TYPE_STRING, &xml_string,
-				  DBUS_TYPE_INVALID);
-
-	g_free (xml_string);
+static void
+listener_set_active (GSListener            *listener,
+		     GDBusMethodInvocation *invocation,
+		     GVariant              *parameters)
+{
+	listener_set_property (listener, invocation, parameters, PROP_ACTIVE);
+}
 
-	if (reply == NULL) {
-		g_error ("No memory");
-	}
+static void
+listener_get_active (GSListener            *listener,
+		     GDBusMethodInvocation *invocation,
+		     GVariant              *parameters)
+{
+	(void) parameters;
 
-	if (! dbus_connection_send (connection, reply, NULL)) {
-		g_error ("No memory");
-	}
+	listener_get_property (listener, invocation, PROP_ACTIVE);
+}
 
-	dbus_message_unref (reply);
+static void
+listener_get_state (GSListener            *listener,
+		    GDBusMethodInvocation *invocation,
+		    GVariant              *parameters)
+{
+	(void) parameters;
+
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new ("(bxbb)",
+							      listener->priv->active,
+							      listener->priv->active_since,
+							      listener->priv->lock_active,
+							      listener_is_inhibited (listener)));
+}
 
-	return DBUS_HANDLER_RESULT_HANDLED;
+static void
+listener_ref_entry_free (GSListenerRefEntry *entry)
+{
+	g_free (entry->sender);
+	g_free (entry->application);
+	g_free (entry->reason);
+	g_free (entry);
 }
 
-static DBusHandlerResult
-send_success_reply (DBusConnection  *connection,
-		    DBusMessage     *message)
+static void
+listener_ref_entries_changed (GSListener *listener,
+			      gboolean    was_inhibited,
+			      gboolean    was_throttled)
 {
-	DBusMessage *reply;
+	gboolean inhibited;
+	gboolean throttled;
 
-	if (dbus_message_get_no_reply (message)) {
-		return DBUS_HANDLER_RESULT_HANDLED;
+	inhibited = listener_is_inhibited (listener);
+	if (inhibited != was_inhibited) {
+		listener_emit_properties_changed (listener, "Inhibited", NULL);
+
+		/* the session may have gone idle in the meantime */
+		if (! inhibited) {
+			listener_check_activation (listener);
+		}
 	}
 
-	reply = dbus_message_new_method_return (message);
-	if (reply == NULL) {
-		g_error ("No memory");
+	throttled = listener->priv->n_throttlers > 0;
+	if (throttled != was_throttled) {
+		g_signal_emit (listener, signals [THROTTLE_CHANGED], 0, throttled);
 	}
+}
 
-	if (! dbus_connection_send (connection, reply, NULL)) {
-		g_error ("No memory");
+static guint32
+listener_add_ref_entry (GSListener *listener,
+			const char *sender,
+			const char *application,
+			const char *reason,
+			gboolean    throttle)
+{
+	GSListenerRefEntry *entry;
+	gboolean            was_inhibited;
+	gboolean            was_throttled;
+	guint               n;
+
+	was_inhibited = listener_is_inhibited (listener);
+	was_throttled = listener->priv->n_throttlers > 0;
+
+	entry = g_new0 (GSListenerRefEntry, 1);
+	entry->sender = g_strdup (sender);
+	entry->application = g_strdup (application);
+	entry->reason = g_strdup (reason);
+	entry->throttle = throttle;
+
+	/* a random, unique, non-zero cookie */
+	do {
+		entry->cookie = g_random_int ();
+	} while (entry->cookie == 0
+		 || g_hash_table_contains (listener->priv->inhibitors,
+					   GUINT_TO_POINTER (entry->cookie)));
+
+	g_hash_table_insert (listener->priv->inhibitors,
+			     GUINT_TO_POINTER (entry->cookie),
+			     entry);
+
+	n = GPOINTER_TO_UINT (g_hash_table_lookup (listener->priv->clients, sender));
+	g_hash_table_replace (listener->priv->clients,
+			      g_strdup (sender),
+			      GUINT_TO_POINTER (n + 1));
+
+	if (throttle) {
+		listener->priv->n_throttlers++;
+	} else {
+		listener->priv->n_inhibitors++;
 	}
 
-	dbus_message_unref (reply);
+	gs_debug ("%s %s by %s (%s) for: %s, cookie %u",
+		  throttle ? "Throttled" : "Inhibited",
+		  throttle ? "themes" : "activation",
+		  application, sender, reason, entry->cookie);
 
-	return DBUS_HANDLER_RESULT_HANDLED;
+	listener_ref_entries_changed (listener, was_inhibited, was_throttled);
+
+	return entry->cookie;
 }
 
-static DBusHandlerResult
-listener_dbus_handle_session_message (DBusConnection *connection,
-				      DBusMessage    *message,
-				      void           *user_data,
-				      dbus_bool_t     local_interface)
+/* Undoes the bookkeeping for an entry about to be removed */
+static void
+listener_forget_ref_entry (GSListener         *listener,
+			   GSListenerRefEntry *entry)
 {
-	GSListener *listener = GS_LISTENER (user_data);
-
-#if 0
-	g_message ("obj_path=%s interface=%s method=%s destination=%s",
-		   dbus_message_get_path (message),
-		   dbus_message_get_interface (message),
-		   dbus_message_get_member (message),
-		   dbus_message_get_destination (message));
-#endif
+	guint n;
 
-	g_return_val_if_fail (connection != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
-	g_return_val_if_fail (message != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
+	gs_debug ("Removing %s by %s (%s), cookie %u",
+		  entry->throttle ? "throttle" : "inhibitor",
+		  entry->application, entry->sender, entry->cookie);
 
-	if (dbus_message_is_method_call (message, GS_SERVICE, "Lock")) {
-		g_signal_emit (listener, signals [LOCK], 0);
-		return send_success_reply (connection, message);
-	}
-	if (dbus_message_is_method_call (message, GS_SERVICE, "Quit")) {
-		g_signal_emit (listener, signals [QUIT], 0);
-		return send_success_reply (connection, message);
-	}
-	if (dbus_message_is_method_call (message, GS_SERVICE, "SetActive")) {
-		return listener_set_property (listener, connection, message, PROP_ACTIVE);
-	}
-	if (dbus_message_is_method_call (message, GS_SERVICE, "GetActive")) {
-		return listener_get_property (listener, connection, message, PROP_ACTIVE);
-	}
-	if (dbus_message_is_method_call (message, GS_SERVICE, "GetActiveTime")) {
-		return listener_get_active_time (listener, connection, message);
-	}
-	if (dbus_message_is_method_call (message, GS_SERVICE, "ShowMessage")) {
-		return listener_show_message (listener, connection, message);
-	}
-	if (dbus_message_is_method_call (message, GS_SERVICE, "SimulateUserActivity")) {
-		g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
-		return send_success_reply (connection, message);
-	}
-	if (dbus_message_is_method_call (message, "org.freedesktop.DBus.Introspectable", "Introspect")) {
-		return do_introspect (connection, message, local_interface);
+	if (entry->throttle) {
+		listener->priv->n_throttlers--;
+	} else {
+		listener->priv->n_inhibitors--;
 	}
 
-	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	n = GPOINTER_TO_UINT (g_hash_table_lookup (listener->priv->clients, entry->sender));
+	if (n > 1) {
+		g_hash_table_replace (listener->priv->clients,
+				      g_strdup (entry->sender),
+				      GUINT_TO_POINTER (n - 1));
+	} else {
+		g_hash_table_remove (listener->priv->clients, entry->sender);
+	}
 }
 
 static gboolean
-_listener_message_path_is_our_session (GSListener  *listener,
-				       DBusMessage *message)
+listener_remove_ref_entry (GSListener *listener,
+			   const char *sender,
+			   guint32     cookie,
+			   gboolean    throttle)
 {
-	const char *ssid;
-
-	ssid = dbus_message_get_path (message);
-	if (ssid == NULL)
+	GSListenerRefEntry *entry;
+	gboolean            was_inhibited;
+	gboolean            was_throttled;
+
+	entry = g_hash_table_lookup (listener->priv->inhibitors, GUINT_TO_POINTER (cookie));
+	if (entry == NULL
+	    || entry->throttle != throttle
+	    || g_strcmp0 (entry->sender, sender) != 0) {
 		return FALSE;
+	}
 
-	if (listener->priv->session_id == NULL)
-		return FALSE;
+	was_inhibited = listener_is_inhibited (listener);
+	was_throttled = listener->priv->n_throttlers > 0;
 
-#ifdef WITH_SYSTEMD
-	/* The bus object path is simply the actual session ID
-	 * prefixed to make it a bus path */
-	if (listener->priv->have_systemd)
-		return g_str_has_prefix (ssid, SYSTEMD_LOGIND_SESSION_PATH "/")
-			&& strcmp (ssid + sizeof (SYSTEMD_LOGIND_SESSION_PATH),
-				   listener->priv->session_id) == 0;
-#endif
+	listener_forget_ref_entry (listener, entry);
+	g_hash_table_remove (listener->priv->inhibitors, GUINT_TO_POINTER (cookie));
 
-#ifdef WITH_CONSOLE_KIT
-	if (strcmp (ssid, listener->priv->session_id) == 0)
-		return TRUE;
-#endif
+	listener_ref_entries_changed (listener, was_inhibited, was_throttled);
 
-	return FALSE;
+	return TRUE;
 }
 
-#ifdef WITH_SYSTEMD
-static gboolean
-properties_changed_match (DBusMessage *message,
-			  const char  *property)
+static void
+listener_remove_client (GSListener *listener,
+			const char *name)
 {
-	DBusMessageIter iter, sub, sub2;
+	GSListenerRefEntry *entry;
+	GHashTableIter      iter;
+	gpointer            value;
+	gboolean            was_inhibited;
+	gboolean            was_throttled;
+
+	was_inhibited = listener_is_inhibited (listener);
+	was_throttled = listener->priv->n_throttlers > 0;
+
+	g_hash_table_iter_init (&iter, listener->priv->inhibitors);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		entry = value;
+
+		if (strcmp (entry->sender, name) == 0) {
+			listener_forget_ref_entry (listener, entry);
+			g_hash_table_iter_remove (&iter);
+		}
+	}
 
-	/* Checks whether a certain property is listed in the
-	 * specified PropertiesChanged message */
+	listener_ref_entries_changed (listener, was_inhibited, was_throttled);
+}
+
+/* One match for every client: the lookup is a single hash probe, so
+ * names coming and going that hold nothing cost next to nothing */
+static void
+listener_name_owner_changed (GDBusConnection *connection,
+			     const char      *sender_name,
+			     const char      *object_path,
+			     const char      *interface_name,
+			     const char      *signal_name,
+			     GVariant        *parameters,
+			     gpointer         user_data)
+{
+	(void) connection;
+	(void) sender_name;
+	(void) object_path;
+	(void) interface_name;
+	(void) signal_name;
 
-	if (!dbus_message_iter_init (message, &iter))
-		goto failure;
+	GSListener *listener = GS_LISTENER (user_data);
+	const char *name;
+	const char *old_owner;
+	const char *new_owner;
 
-	/* Jump over interface name */
-	if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_STRING)
-		goto failure;
+	if (! g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sss)"))) {
+		return;
+	}
 
-	dbus_message_iter_next (&iter);
+	g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
 
-	/* First, iterate through the changed properties array */
-	if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY ||
-	    dbus_message_iter_get_element_type (&iter) != DBUS_TYPE_DICT_ENTRY)
-		goto failure;
+	if (*new_owner != '\0'
+	    || ! g_hash_table_contains (listener->priv->clients, name)) {
+		return;
+	}
 
-	dbus_message_iter_recurse (&iter, &sub);
-	while (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_INVALID) {
-		const char *name;
+	gs_debug ("%s left the bus", name);
+	listener_remove_client (listener, name);
+}
 
-		if (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_DICT_ENTRY)
-			goto failure;
+/* Only for when the bus went away: there is nobody to tell that we
+ * are no longer inhibited, and losing the bus is no reason to activate */
+static void
+listener_clear_ref_entries (GSListener *listener)
+{
+	gboolean was_throttled;
 
-		dbus_message_iter_recurse (&sub, &sub2);
-		dbus_message_iter_get_basic (&sub2, &name);
+	was_throttled = listener->priv->n_throttlers > 0;
 
-		if (strcmp (name, property) == 0)
-			return TRUE;
+	g_hash_table_remove_all (listener->priv->inhibitors);
+	g_hash_table_remove_all (listener->priv->clients);
+	listener->priv->n_inhibitors = 0;
+	listener->priv->n_throttlers = 0;
 
-		dbus_message_iter_next (&sub);
+	if (was_throttled) {
+		g_signal_emit (listener, signals [THROTTLE_CHANGED], 0, FALSE);
 	}
+}
 
-	dbus_message_iter_next (&iter);
+static void
+listener_add_ref (GSListener            *listener,
+		  GDBusMethodInvocation *invocation,
+		  GVariant              *parameters,
+		  gboolean               throttle)
+{
+	const char *application;
+	const char *reason;
+	guint32     cookie;
 
-	/* Second, iterate through the invalidated properties array */
-	if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY ||
-	    dbus_message_iter_get_element_type (&iter) != DBUS_TYPE_STRING)
-		goto failure;
+	g_variant_get (parameters, "(&s&s)", &application, &reason);
 
-	dbus_message_iter_recurse (&iter, &sub);
-	while (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_INVALID) {
-		const char *name;
+	cookie = listener_add_ref_entry (listener,
+					 g_dbus_method_invocation_get_sender (invocation),
+					 application,
+					 reason,
+					 throttle);
 
-		if (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_STRING)
-			goto failure;
+	g_dbus_method_invocation_return_value (invocation, g_variant_new ("(u)", cookie));
+}
 
-		dbus_message_iter_get_basic (&sub, &name);
+static void
+listener_remove_ref (GSListener            *listener,
+		     GDBusMethodInvocation *invocation,
+		     GVariant              *parameters,
+		     gboolean               throttle)
+{
+	guint32 cookie;
 
-		if (strcmp (name, property) == 0)
-			return TRUE;
+	g_variant_get (parameters, "(u)", &cookie);
 
-		dbus_message_iter_next (&sub);
+	if (! listener_remove_ref_entry (listener,
+					 g_dbus_method_invocation_get_sender (invocation),
+					 cookie,
+					 throttle)) {
+		raise_error (invocation,
+			     GENERAL_ERROR,
+			     "Unable to %s: cookie %u not found",
+			     throttle ? "UnThrottle" : "UnInhibit",
+			     cookie);
+		return;
 	}
 
-	return FALSE;
-
-failure:
-	gs_debug ("Failed to decode PropertiesChanged message.");
-	return FALSE;
+	send_success_reply (invocation);
 }
-#endif
 
-static DBusHandlerResult
-listener_dbus_handle_system_message (DBusConnection *connection,
-				     DBusMessage    *message,
-				     void           *user_data,
-				     dbus_bool_t     local_interface)
+static void
+listener_inhibit (GSListener            *listener,
+		  GDBusMethodInvocation *invocation,
+		  GVariant              *parameters)
 {
-	(void) local_interface;
+	listener_add_ref (listener, invocation, parameters, FALSE);
+}
 
-	GSListener *listener = GS_LISTENER (user_data);
+static void
+listener_uninhibit (GSListener            *listener,
+		    GDBusMethodInvocation *invocation,
+		    GVariant              *parameters)
+{
+	listener_remove_ref (listener, invocation, parameters, FALSE);
+}
+
+/* Kept for gnome-screensaver clients: throttles are tracked and
+ * "throttle-changed" is emitted, but there are no themes to stop */
+static void
+listener_throttle (GSListener            *listener,
+		   GDBusMethodInvocation *invocation,
+		   GVariant              *parameters)
+{
+	listener_add_ref (listener, invocation, parameters, TRUE);
+}
+
+static void
+listener_unthrottle (GSListener            *listener,
+		     GDBusMethodInvocation *invocation,
+		     GVariant              *parameters)
+{
+	listener_remove_ref (listener, invocation, parameters, TRUE);
+}
+
+static void
+listener_cycle (GSListener            *listener,
+		GDBusMethodInvocation *invocation,
+		GVariant              *parameters)
+{
+	(void) listener;
+	(void) parameters;
+
+	/* there are no themes to cycle through, only a blank screen */
+	gs_debug ("Ignoring request to cycle themes");
+	send_success_reply (invocation);
+}
+
+typedef void (*GSListenerMethodFunc) (GSListener            *listener,
+				      GDBusMethodInvocation *invocation,
+				      GVariant              *parameters);
+
+typedef struct {
+	const char           *name;
+	GSListenerMethodFunc  func;
+} GSListenerMethod;
+
+static const GSListenerMethod listener_methods [] = {
+	{ "Lock",                 listener_lock },
+	{ "Quit",                 listener_quit },
+	{ "Cycle",                listener_cycle },
+	{ "Inhibit",              listener_inhibit },
+	{ "UnInhibit",            listener_uninhibit },
+	{ "Throttle",             listener_throttle },
+	{ "UnThrottle",           listener_unthrottle },
+	{ "SimulateUserActivity", listener_simulate_user_activity },
+	{ "GetActive",            listener_get_active },
+	{ "GetActiveTime",        listener_get_active_time },
+	{ "GetActiveDuration",    listener_get_active_duration },
+	{ "GetStats",             listener_get_stats },
+	{ "SetActive",            listener_set_active },
+	{ "ShowMessage",          listener_show_message },
+	{ "GetState",             listener_get_state },
+};
+
+/* method name -> GSListenerMethodFunc, filled in once by class_init */
+static GHashTable *method_table = NULL;
+
+static void
+listener_build_method_table (void)
+{
+	guint i;
+
+	method_table = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; i < G_N_ELEMENTS (listener_methods); i++) {
+		g_hash_table_insert (method_table,
+				     (gpointer) listener_methods [i].name,
+				     (gpointer) listener_methods [i].func);
+	}
+}
+
+static GSListenerMethodFunc
+listener_lookup_method (const char *method_name)
+{
+	return (GSListenerMethodFunc) g_hash_table_lookup (method_table, method_name);
+}
 
-	g_return_val_if_fail (connection != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
-	g_return_val_if_fail (message != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
+static void
+listener_dbus_handle_method_call (GDBusConnection       *connection,
+				  const char            *sender,
+				  const char            *object_path,
+				  const char            *interface_name,
+				  const char            *method_name,
+				  GVariant              *parameters,
+				  GDBusMethodInvocation *invocation,
+				  gpointer               user_data)
+{
+	(void) connection;
+	(void) sender;
+	(void) object_path;
+	(void) interface_name;
 
-#if 1
-	gs_debug ("obj_path=%s interface=%s method=%s destination=%s",
-		  dbus_message_get_path (message),
-		  dbus_message_get_interface (message),
-		  dbus_message_get_member (message),
-		  dbus_message_get_destination (message));
+	GSListener          *listener = GS_LISTENER (user_data);
+	GSListenerMethodFunc func;
+
+#if 0
+	g_message ("obj_path=%s interface=%s method=%s sender=%s",
+		   object_path,
+		   interface_name,
+		   method_name,
+		   sender);
 #endif
 
-#ifdef WITH_SYSTEMD
+	/* GDBus has already checked the name and signature against
+	 * the introspection data, so a miss here means the table and
+	 * the XML disagree */
+	func = listener_lookup_method (method_name);
+	if (func == NULL) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_UNKNOWN_METHOD,
+						       "Unknown method %s",
+						       method_name);
+		return;
+	}
 
-	if (listener->priv->have_systemd) {
+	func (listener, invocation, parameters);
+}
 
-		if (dbus_message_is_signal (message, SYSTEMD_LOGIND_SESSION_INTERFACE, "Unlock")) {
-			if (_listener_message_path_is_our_session (listener, message)) {
-				gs_debug ("systemd requested session unlock");
-				gs_listener_set_active (listener, FALSE);
-			}
+static GVariant *
+listener_dbus_handle_get_property (GDBusConnection  *connection,
+				   const char       *sender,
+				   const char       *object_path,
+				   const char       *interface_name,
+				   const char       *property_name,
+				   GError          **error,
+				   gpointer          user_data)
+{
+	(void) connection;
+	(void) sender;
+	(void) object_path;
 
-			return DBUS_HANDLER_RESULT_HANDLED;
-		} else if (dbus_message_is_signal (message, SYSTEMD_LOGIND_SESSION_INTERFACE, "Lock")) {
-			if (_listener_message_path_is_our_session (listener, message)) {
-				gs_debug ("systemd requested session lock");
-				g_signal_emit (listener, signals [LOCK], 0);
-			}
+	GSListener *listener = GS_LISTENER (user_data);
+	GVariant   *value;
 
-			return DBUS_HANDLER_RESULT_HANDLED;
-		} else if (dbus_message_is_signal (message, SYSTEMD_LOGIND_INTERFACE, "PrepareForSleep")) {
-			gboolean active;
-			if (dbus_message_get_args (message, NULL,
-				    DBUS_TYPE_BOOLEAN, &active,
-				    DBUS_TYPE_INVALID) && active) {
-				gs_debug ("systemd notified that system is about to sleep");
-				g_signal_emit (listener, signals [CONFIG_LOCK], 0);
-			} else {
-				gs_debug ("cannot parse PrepareForSleep");
-			}
-			return DBUS_HANDLER_RESULT_HANDLED;
-		} else if (dbus_message_is_signal (message, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged")) {
+	if (strcmp (interface_name, GS_STATS_INTERFACE) == 0) {
+		value = listener_get_stats_property (property_name);
+	} else {
+		value = listener_get_state_property (listener, property_name);
+	}
+	if (value == NULL) {
+		g_set_error (error,
+			     G_DBUS_ERROR,
+			     G_DBUS_ERROR_UNKNOWN_PROPERTY,
+			     "Unknown property %s",
+			     property_name);
+	}
 
-			if (_listener_message_path_is_our_session (listener, message)) {
+	return value;
+}
 
-				if (properties_changed_match (message, "Active")) {
-					gboolean new_active;
+#ifdef WITH_SYSTEMD
+static gboolean
+properties_changed_match (GVariant   *parameters,
+			  const char *property)
+{
+	GVariant    *changed;
+	GVariant    *value;
+	const char **invalidated;
+	gboolean     ret;
+	guint        i;
 
-					/* Instead of going via the
-					 * bus to read the new
-					 * property state, let's
-					 * shortcut this and ask
-					 * directly the low-level
-					 * information */
+	/* Checks whether a certain property is listed in the
+	 * specified PropertiesChanged message */
 
-					new_active = sd_session_is_active (listener->priv->session_id) != 0;
-					if (new_active)
-						g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
-				}
-			}
+	if (! g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)"))) {
+		gs_debug ("Failed to decode PropertiesChanged message.");
+		return FALSE;
+	}
 
-			return DBUS_HANDLER_RESULT_HANDLED;
-		}
+	/* First, look through the changed properties array */
+	changed = g_variant_get_child_value (parameters, 1);
+	value = g_variant_lookup_value (changed, property, NULL);
+	g_variant_unref (changed);
 
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	if (value != NULL) {
+		g_variant_unref (value);
+		return TRUE;
 	}
-#endif
 
-#ifdef WITH_CONSOLE_KIT
-	if (dbus_message_is_signal (message, CK_SESSION_INTERFACE, "Unlock")) {
-		if (_listener_message_path_is_our_session (listener, message)) {
-			gs_debug ("Console kit requested session unlock");
-			gs_listener_set_active (listener, FALSE);
-		}
+	/* Second, look through the invalidated properties array */
+	g_variant_get_child (parameters, 2, "^a&s", &invalidated);
 
-		return DBUS_HANDLER_RESULT_HANDLED;
-	} else if (dbus_message_is_signal (message, CK_SESSION_INTERFACE, "Lock")) {
-		if (_listener_message_path_is_our_session (listener, message)) {
-			gs_debug ("ConsoleKit requested session lock");
-			g_signal_emit (listener, signals [LOCK], 0);
+	ret = FALSE;
+	for (i = 0; invalidated [i] != NULL; i++) {
+		if (strcmp (invalidated [i], property) == 0) {
+			ret = TRUE;
+			break;
 		}
+	}
 
-		return DBUS_HANDLER_RESULT_HANDLED;
-	} else if (dbus_message_is_signal (message, CK_SESSION_INTERFACE, "ActiveChanged")) {
-		/* NB that `ActiveChanged' refers to the active
-		 * session in ConsoleKit terminology - ie which
-		 * session is currently displayed on the screen.
-		 * gnome-screensaver uses `active' to mean `is the
-		 * screensaver active' (ie, is the screen locked) but
-		 * that's not what we're referring to here.
-		 */
+	g_free (invalidated);
 
-		if (_listener_message_path_is_our_session (listener, message)) {
-			DBusError   error;
-			dbus_bool_t new_active;
+	return ret;
+}
+#endif
 
-			dbus_error_init (&error);
-			if (dbus_message_get_args (message, &error,
-						   DBUS_TYPE_BOOLEAN, &new_active,
-						   DBUS_TYPE_INVALID)) {
-				gs_debug ("ConsoleKit notified ActiveChanged %d", new_active);
+#ifdef WITH_SYSTEMD
+static void
+sleep_inhibitor_cb (GObject      *source,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	GSListener  *listener;
+	GUnixFDList *fd_list;
+	GVariant    *reply;
+	GError      *error;
+	gint32       index;
+
+	error = NULL;
+	fd_list = NULL;
+	reply = g_dbus_connection_call_with_unix_fd_list_finish (G_DBUS_CONNECTION (source),
+								 &fd_list,
+								 result,
+								 &error);
+	if (reply == NULL) {
+		if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			GS_LISTENER (user_data)->priv->sleep_inhibit_pending = FALSE;
+			g_warning ("Couldn't take the sleep inhibitor: %s", error->message);
+		}
+		g_error_free (error);
+		return;
+	}
 
-				/* when we become active poke the lock */
-				if (new_active) {
-					g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
-				}
-			}
+	listener = GS_LISTENER (user_data);
+	listener->priv->sleep_inhibit_pending = FALSE;
 
-			if (dbus_error_is_set (&error)) {
-				dbus_error_free (&error);
-			}
-		}
+	g_variant_get (reply, "(h)", &index);
+	g_variant_unref (reply);
 
-		return DBUS_HANDLER_RESULT_HANDLED;
+	error = NULL;
+	listener->priv->sleep_inhibit_fd = g_unix_fd_list_get (fd_list, index, &error);
+	if (listener->priv->sleep_inhibit_fd < 0) {
+		g_warning ("Couldn't take the sleep inhibitor: %s", error->message);
+		g_error_free (error);
+	} else {
+		gs_debug ("Took the sleep inhibitor");
 	}
-#endif
 
-       return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	g_object_unref (fd_list);
 }
 
-static DBusHandlerResult
-gs_listener_message_handler (DBusConnection *connection,
-			     DBusMessage    *message,
-			     void           *user_data)
+/* A delay lock makes logind hold off suspending, for up to
+ * InhibitDelayMaxSec, until the fd is closed again */
+static void
+listener_take_sleep_inhibitor (GSListener *listener)
 {
-	g_return_val_if_fail (connection != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
-	g_return_val_if_fail (message != NULL, DBUS_HANDLER_RESULT_NOT_YET_HANDLED);
+	if (listener->priv->system_connection == NULL
+	    || listener->priv->sleep_inhibit_fd >= 0
+	    || listener->priv->sleep_inhibit_pending) {
+		return;
+	}
+
+	listener->priv->sleep_inhibit_pending = TRUE;
+
+	g_dbus_connection_call_with_unix_fd_list (listener->priv->system_connection,
+						  SYSTEMD_LOGIND_SERVICE,
+						  SYSTEMD_LOGIND_PATH,
+						  SYSTEMD_LOGIND_INTERFACE,
+						  "Inhibit",
+						  g_variant_new ("(ssss)",
+								 "sleep",
+								 "budgie-screensaver",
+								 _("Lock the screen before suspending"),
+								 "delay"),
+						  G_VARIANT_TYPE ("(h)"),
+						  G_DBUS_CALL_FLAGS_NONE,
+						  -1,
+						  NULL,
+						  listener->priv->cancellable,
+						  sleep_inhibitor_cb,
+						  listener);
+}
 
-#if 0
-	g_message ("obj_path=%s interface=%s method=%s destination=%s",
-		   dbus_message_get_path (message),
-		   dbus_message_get_interface (message),
-		   dbus_message_get_member (message),
-		   dbus_message_get_destination (message));
-#endif
+static void
+listener_release_sleep_inhibitor (GSListener *listener)
+{
+	if (listener->priv->sleep_inhibit_fd < 0) {
+		return;
+	}
 
-	if (dbus_message_is_method_call (message, "org.freedesktop.DBus", "AddMatch")) {
-		DBusMessage *reply;
+	gs_debug ("Releasing the sleep inhibitor");
+	close (listener->priv->sleep_inhibit_fd);
+	listener->priv->sleep_inhibit_fd = -1;
+}
 
-		reply = dbus_message_new_method_return (message);
+static void
+inhibit_delay_max_cb (GObject      *source,
+		      GAsyncResult *result,
+		      gpointer      user_data)
+{
+	GSListener *listener;
+	GVariant   *reply;
+	GVariant   *value;
+	GError     *error;
 
-		if (reply == NULL) {
-			g_error ("No memory");
+	error = NULL;
+	reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+	if (reply == NULL) {
+		if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			gs_debug ("Couldn't read InhibitDelayMaxUSec: %s", error->message);
 		}
+		g_error_free (error);
+		return;
+	}
 
-		if (! dbus_connection_send (connection, reply, NULL)) {
-			g_error ("No memory");
-		}
+	listener = GS_LISTENER (user_data);
 
-		dbus_message_unref (reply);
+	g_variant_get (reply, "(v)", &value);
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE ("t"))) {
+		listener->priv->inhibit_delay_max = g_variant_get_uint64 (value);
+		gs_debug ("logind waits at most %" G_GUINT64_FORMAT " ms for us before sleeping",
+			  listener->priv->inhibit_delay_max / 1000);
+	}
 
-		return DBUS_HANDLER_RESULT_HANDLED;
-	} else if (dbus_message_is_signal (message, DBUS_INTERFACE_LOCAL, "Disconnected") &&
-		   strcmp (dbus_message_get_path (message), DBUS_PATH_LOCAL) == 0) {
-		dbus_connection_unref (connection);
+	g_variant_unref (value);
+	g_variant_unref (reply);
+}
 
-		return DBUS_HANDLER_RESULT_HANDLED;
-	} else {
-		return listener_dbus_handle_session_message (connection, message, user_data, TRUE);
+static void
+listener_query_inhibit_delay_max (GSListener *listener)
+{
+	g_dbus_connection_call (listener->priv->system_connection,
+				SYSTEMD_LOGIND_SERVICE,
+				SYSTEMD_LOGIND_PATH,
+				"org.freedesktop.DBus.Properties",
+				"Get",
+				g_variant_new ("(ss)",
+					       SYSTEMD_LOGIND_INTERFACE,
+					       "InhibitDelayMaxUSec"),
+				G_VARIANT_TYPE ("(v)"),
+				G_DBUS_CALL_FLAGS_NONE,
+				-1,
+				listener->priv->cancellable,
+				inhibit_delay_max_cb,
+				listener);
+}
+
+static void
+listener_sleep_lock_done (GSListener *listener)
+{
+	gint64 elapsed;
+
+	if (listener->priv->sleep_timeout_id > 0) {
+		g_source_remove (listener->priv->sleep_timeout_id);
+		listener->priv->sleep_timeout_id = 0;
 	}
+
+	elapsed = g_get_monotonic_time () - listener->priv->sleep_start;
+	listener->priv->sleep_start = 0;
+
+	gs_debug ("Ready to sleep %" G_GINT64_FORMAT " ms after PrepareForSleep",
+		  elapsed / 1000);
+	gs_stats_add ("sleep-lock", elapsed);
+
+	if ((guint64) elapsed > listener->priv->inhibit_delay_max) {
+		g_warning ("Locking the screen took longer than logind waits before sleeping");
+	}
+
+	listener_release_sleep_inhibitor (listener);
 }
 
 static gboolean
-gs_listener_dbus_init (GSListener *listener)
+sleep_lock_timeout (GSListener *listener)
 {
-	DBusError error;
+	gs_debug ("Gave up waiting for the screen to lock");
 
-	dbus_error_init (&error);
+	listener->priv->sleep_timeout_id = 0;
+	listener_sleep_lock_done (listener);
 
-	if (listener->priv->connection == NULL) {
-		listener->priv->connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
-		if (listener->priv->connection == NULL) {
-			if (dbus_error_is_set (&error)) {
-				gs_debug ("couldn't connect to session bus: %s",
-					  error.message);
-				dbus_error_free (&error);
-			}
-			return FALSE;
-		}
+	return FALSE;
+}
 
-		dbus_connection_setup_with_g_main (listener->priv->connection, NULL);
-		dbus_connection_set_exit_on_disconnect (listener->priv->connection, FALSE);
+static void
+listener_prepare_for_sleep (GSListener *listener)
+{
+	guint timeout;
+
+	if (listener->priv->sleep_start > 0) {
+		return;
 	}
 
-	if (listener->priv->system_connection == NULL) {
-		listener->priv->system_connection = dbus_bus_get (DBUS_BUS_SYSTEM, &error);
-		if (listener->priv->system_connection == NULL) {
-			if (dbus_error_is_set (&error)) {
-				gs_debug ("couldn't connect to system bus: %s",
-					  error.message);
-				dbus_error_free (&error);
-			}
-			return FALSE;
-		}
+	listener->priv->sleep_start = g_get_monotonic_time ();
+
+	g_signal_emit (listener, signals [CONFIG_LOCK], 0);
 
-		dbus_connection_setup_with_g_main (listener->priv->system_connection, NULL);
-		dbus_connection_set_exit_on_disconnect (listener->priv->system_connection, FALSE);
+	/* Either we were not allowed to lock, or the windows were already
+	 * up and grabbed and just got locked: nothing to wait for.  An
+	 * activation still in progress, one that started during a fade
+	 * or just before this, is waited for like a new one */
+	if (! listener->priv->active || listener->priv->activate_requested == 0) {
+		listener_sleep_lock_done (listener);
+		return;
 	}
 
-	return TRUE;
+	/* otherwise gs_listener_activation_finished() lets logind go.
+	 * Give up a little before logind does, so that the lock isn't
+	 * still taken when it suspends without us */
+	timeout = listener->priv->inhibit_delay_max / 1000;
+	if (timeout > 2 * SLEEP_LOCK_MARGIN) {
+		timeout -= SLEEP_LOCK_MARGIN;
+	} else {
+		timeout /= 2;
+	}
+
+	listener->priv->sleep_timeout_id = g_timeout_add (timeout,
+							  (GSourceFunc) sleep_lock_timeout,
+							  listener);
 }
+#endif
 
-static gboolean
-reinit_dbus (GSListener *listener)
+void
+gs_listener_activation_finished (GSListener *listener)
 {
-	gboolean initialized;
-	gboolean try_again;
-
-	initialized = gs_listener_dbus_init (listener);
+	g_return_if_fail (GS_IS_LISTENER (listener));
 
-	/* if we didn't initialize then try again */
-	/* FIXME: Should we keep trying forever?  If we fail more than
-	   once or twice then the session bus may have died.  The
-	   problem is that if it is restarted it will likely have a
-	   different bus address and we won't be able to find it */
-	try_again = !initialized;
+	if (listener->priv->activate_requested > 0) {
+		gs_stats_add ("activation",
+			      g_get_monotonic_time () - listener->priv->activate_requested);
+		listener->priv->activate_requested = 0;
+	}
 
-	return try_again;
+#ifdef WITH_SYSTEMD
+	if (listener->priv->sleep_start > 0) {
+		listener_sleep_lock_done (listener);
+	}
+#endif
 }
 
-static DBusHandlerResult
-listener_dbus_filter_function (DBusConnection *connection,
-			       DBusMessage    *message,
-			       void           *user_data)
+/* Only signals from our own session, and PrepareForSleep, are
+ * subscribed to, so everything that arrives here concerns us */
+static void
+listener_dbus_handle_system_message (GDBusConnection *connection,
+				     const char      *sender_name,
+				     const char      *object_path,
+				     const char      *interface_name,
+				     const char      *signal_name,
+				     GVariant        *parameters,
+				     gpointer         user_data)
 {
+	(void) connection;
+
 	GSListener *listener = GS_LISTENER (user_data);
-	const char *path;
 
-	path = dbus_message_get_path (message);
-
-	/*
-	g_message ("obj_path=%s interface=%s method=%s",
-		   dbus_message_get_path (message),
-		   dbus_message_get_interface (message),
-		   dbus_message_get_member (message));
-	*/
-
-	if (dbus_message_is_signal (message, DBUS_INTERFACE_LOCAL, "Disconnected")
-	    && strcmp (path, DBUS_PATH_LOCAL) == 0) {
-
-		g_message ("Got disconnected from the session message bus; "
-			   "retrying to reconnect every 10 seconds");
-
-		dbus_connection_unref (connection);
-		listener->priv->connection = NULL;
-
-		g_timeout_add (10000, (GSourceFunc)reinit_dbus, listener);
-	} else if (dbus_message_is_signal (message,
-					   DBUS_INTERFACE_DBUS,
-					   "NameLost")) {
-		const char *name;
-		DBusError error;
-		dbus_error_init (&error);
-
-		if (!dbus_message_get_args (message, &error,
-					    DBUS_TYPE_STRING, &name,
-					    DBUS_TYPE_INVALID)) {
-		    g_warning("Got NameLost, but couldn't read name");
-		    dbus_error_free (&error);
-		} else {
-		    if (strcmp (name, GS_INTERFACE) == 0) { // We've been replaced
-			g_message ("Lost the name, shutting down.");
-			dbus_connection_unref (connection);
-			listener->priv->connection = NULL;
-			gtk_main_quit ();
-		    }
+	gs_debug ("obj_path=%s interface=%s signal=%s sender=%s",
+		  object_path,
+		  interface_name,
+		  signal_name,
+		  sender_name);
+
+	listener->priv->system_handled++;
+
+#ifdef WITH_SYSTEMD
+
+	if (listener->priv->have_systemd) {
+
+		if (strcmp (signal_name, "Unlock") == 0) {
+			gs_debug ("systemd requested session unlock");
+			gs_listener_set_active (listener, FALSE);
+		} else if (strcmp (signal_name, "Lock") == 0) {
+			gs_debug ("systemd requested session lock");
+			g_signal_emit (listener, signals [LOCK], 0);
+		} else if (strcmp (signal_name, "PrepareForSleep") == 0) {
+			gboolean active;
+
+			if (! g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)"))) {
+				gs_debug ("cannot parse PrepareForSleep");
+				return;
+			}
+
+			g_variant_get (parameters, "(b)", &active);
+			if (active) {
+				gs_debug ("systemd notified that system is about to sleep");
+				listener_prepare_for_sleep (listener);
+			} else {
+				gs_debug ("systemd notified that system has resumed");
+
+				/* logind may have stopped waiting before we
+				 * were done, the old lock is of no use now */
+				if (listener->priv->sleep_start > 0) {
+					listener_sleep_lock_done (listener);
+				}
+				listener_take_sleep_inhibitor (listener);
+			}
+		} else if (strcmp (signal_name, "PropertiesChanged") == 0) {
+
+			if (properties_changed_match (parameters, "Active")) {
+				gboolean new_active;
+
+				/* Instead of going via the
+				 * bus to read the new
+				 * property state, let's
+				 * shortcut this and ask
+				 * directly the low-level
+				 * information */
+
+				new_active = sd_session_is_active (listener->priv->session_id) != 0;
+				if (new_active)
+					g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
+			}
 		}
-	} else {
-		return listener_dbus_handle_session_message (connection, message, user_data, FALSE);
+
+		return;
+	}
+#endif
+
+#ifdef WITH_CONSOLE_KIT
+	if (strcmp (signal_name, "Unlock") == 0) {
+		gs_debug ("Console kit requested session unlock");
+		gs_listener_set_active (listener, FALSE);
+	} else if (strcmp (signal_name, "Lock") == 0) {
+		gs_debug ("ConsoleKit requested session lock");
+		g_signal_emit (listener, signals [LOCK], 0);
+	} else if (strcmp (signal_name, "ActiveChanged") == 0) {
+		/* NB that `ActiveChanged' refers to the active
+		 * session in ConsoleKit terminology - ie which
+		 * session is currently displayed on the screen.
+		 * gnome-screensaver uses `active' to mean `is the
+		 * screensaver active' (ie, is the screen locked) but
+		 * that's not what we're referring to here.
+		 */
+
+		if (g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)"))) {
+			gboolean new_active;
+
+			g_variant_get (parameters, "(b)", &new_active);
+			gs_debug ("ConsoleKit notified ActiveChanged %d", new_active);
+
+			/* when we become active poke the lock */
+			if (new_active) {
+				g_signal_emit (listener, signals [SIMULATE_USER_ACTIVITY], 0);
+			}
+		}
+	}
+#else
+	(void) parameters;
+#endif
+}
+
+/* Runs in the GDBus worker thread, for every message the bus sends
+ * us, whether or not anything is subscribed to it */
+static GDBusMessage *
+listener_system_filter (GDBusConnection *connection,
+			GDBusMessage    *message,
+			gboolean         incoming,
+			gpointer         user_data)
+{
+	(void) connection;
+
+	GSListener *listener = GS_LISTENER (user_data);
+
+	if (incoming) {
+		g_atomic_int_inc (&listener->priv->system_received);
 	}
 
-	return DBUS_HANDLER_RESULT_HANDLED;
+	return message;
 }
 
-static DBusHandlerResult
-listener_dbus_system_filter_function (DBusConnection *connection,
-				      DBusMessage    *message,
-				      void           *user_data)
+static void
+listener_name_acquired_cb (GDBusConnection *connection,
+			   const char      *name,
+			   gpointer         user_data)
 {
+	(void) connection;
+
 	GSListener *listener = GS_LISTENER (user_data);
-	const char *path;
 
-	path = dbus_message_get_path (message);
+	gs_debug ("Acquired the name %s on the session bus", name);
+	listener->priv->name_acquired = TRUE;
+}
 
-	if (dbus_message_is_signal (message, DBUS_INTERFACE_LOCAL, "Disconnected")
-	    && strcmp (path, DBUS_PATH_LOCAL) == 0) {
+static void
+listener_name_lost_cb (GDBusConnection *connection,
+		       const char      *name,
+		       gpointer         user_data)
+{
+	(void) name;
 
-		g_message ("Got disconnected from the system message bus; "
-			   "retrying to reconnect every 10 seconds");
+	GSListener *listener = GS_LISTENER (user_data);
 
-		dbus_connection_unref (connection);
-		listener->priv->system_connection = NULL;
+	/* a closed connection is handled by the reconnect logic */
+	if (connection == NULL || g_dbus_connection_is_closed (connection)) {
+		return;
+	}
 
-		g_timeout_add (10000, (GSourceFunc)reinit_dbus, listener);
+	if (listener->priv->name_acquired) {
+		/* We've been replaced */
+		g_message ("Lost the name, shutting down.");
 	} else {
-		return listener_dbus_handle_system_message (connection, message, user_data, FALSE);
+		g_warning ("%s", _("screensaver already running in this session"));
 	}
 
-	return DBUS_HANDLER_RESULT_HANDLED;
+	gtk_main_quit ();
 }
 
 static void
@@ -1254,6 +1916,17 @@ gs_listener_class_init (GSListenerClass *klass)
 			      G_TYPE_BOOLEAN,
 			      1,
 			      G_TYPE_BOOLEAN);
+	signals [THROTTLE_CHANGED] =
+		g_signal_new ("throttle-changed",
+			      G_TYPE_FROM_CLASS (object_class),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (GSListenerClass, throttle_changed),
+			      NULL,
+			      NULL,
+			      g_cclosure_marshal_VOID__BOOLEAN,
+			      G_TYPE_NONE,
+			      1,
+			      G_TYPE_BOOLEAN);
 	signals [SHOW_MESSAGE] =
 		g_signal_new ("show-message",
 			      G_TYPE_FROM_CLASS (object_class),
@@ -1282,153 +1955,301 @@ gs_listener_class_init (GSListenerClass *klass)
 							       NULL,
 							       TRUE,
 							       G_PARAM_READWRITE));
+
+	introspection_data = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+	g_assert (introspection_data != NULL);
+
+	listener_build_method_table ();
 }
 
-gboolean
-gs_listener_acquire (GSListener *listener,
-		     GError    **error)
+static void
+listener_subscribe_system_signal (GSListener *listener,
+				  guint       index,
+				  const char *sender,
+				  const char *object_path,
+				  const char *interface_name,
+				  const char *member,
+				  const char *arg0)
 {
-	int       res;
-	DBusError buserror;
-	gboolean  is_connected;
+	listener->priv->system_subscriptions [index] =
+		g_dbus_connection_signal_subscribe (listener->priv->system_connection,
+						    sender,
+						    interface_name,
+						    member,
+						    object_path,
+						    arg0,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    listener_dbus_handle_system_message,
+						    listener,
+						    NULL);
+}
 
-	g_return_val_if_fail (listener != NULL, FALSE);
+/* Called once we are acquired and again when the session path
+ * becomes known, whichever happens last does the work */
+static void
+listener_subscribe_session_signals (GSListener *listener)
+{
+	const char *path;
 
-	if (! listener->priv->connection) {
-		g_set_error (error,
-			     GS_LISTENER_ERROR,
-			     GS_LISTENER_ERROR_ACQUISITION_FAILURE,
-			     "%s",
-			     _("failed to register with the message bus"));
-		return FALSE;
+	path = listener->priv->session_path;
+
+	if (listener->priv->system_connection == NULL
+	    || ! listener->priv->acquired
+	    || path == NULL
+	    || listener->priv->system_subscriptions [SYSTEM_SIGNAL_LOCK] > 0) {
+		return;
+	}
+
+	gs_debug ("Watching session %s", path);
+
+#ifdef WITH_SYSTEMD
+	if (listener->priv->have_systemd) {
+		listener_subscribe_system_signal (listener, SYSTEM_SIGNAL_LOCK,
+						  SYSTEMD_LOGIND_SERVICE,
+						  path,
+						  SYSTEMD_LOGIND_SESSION_INTERFACE,
+						  "Lock",
+						  NULL);
+		listener_subscribe_system_signal (listener, SYSTEM_SIGNAL_UNLOCK,
+						  SYSTEMD_LOGIND_SERVICE,
+						  path,
+						  SYSTEMD_LOGIND_SESSION_INTERFACE,
+						  "Unlock",
+						  NULL);
+		listener_subscribe_system_signal (listener, SYSTEM_SIGNAL_ACTIVE,
+						  SYSTEMD_LOGIND_SERVICE,
+						  path,
+						  "org.freedesktop.DBus.Properties",
+						  "PropertiesChanged",
+						  SYSTEMD_LOGIND_SESSION_INTERFACE);
+		return;
 	}
+#endif
+
+#ifdef WITH_CONSOLE_KIT
+	listener_subscribe_system_signal (listener, SYSTEM_SIGNAL_LOCK,
+					  CK_SERVICE,
+					  path,
+					  CK_SESSION_INTERFACE,
+					  "Lock",
+					  NULL);
+	listener_subscribe_system_signal (listener, SYSTEM_SIGNAL_UNLOCK,
+					  CK_SERVICE,
+					  path,
+					  CK_SESSION_INTERFACE,
+					  "Unlock",
+					  NULL);
+	listener_subscribe_system_signal (listener, SYSTEM_SIGNAL_ACTIVE,
+					  CK_SERVICE,
+					  path,
+					  CK_SESSION_INTERFACE,
+					  "ActiveChanged",
+					  NULL);
+#endif
+}
 
-	is_connected = dbus_connection_get_is_connected (listener->priv->connection);
-	if (! is_connected) {
+static gboolean
+listener_register (GSListener *listener,
+		   GError    **error)
+{
+	GError *local_error;
+
+	local_error = NULL;
+	listener->priv->registration_id =
+		g_dbus_connection_register_object (listener->priv->connection,
+						   GS_PATH,
+						   introspection_data->interfaces [0],
+						   &gs_listener_vtable,
+						   listener,
+						   NULL,
+						   &local_error);
+	if (listener->priv->registration_id == 0) {
 		g_set_error (error,
 			     GS_LISTENER_ERROR,
 			     GS_LISTENER_ERROR_ACQUISITION_FAILURE,
 			     "%s",
-			     _("not connected to the message bus"));
+			     local_error->message);
+		g_error_free (local_error);
 		return FALSE;
 	}
 
-	dbus_error_init (&buserror);
+	/* the counters are a diagnostic aid, carry on without them */
+	listener->priv->stats_registration_id =
+		g_dbus_connection_register_object (listener->priv->connection,
+						   GS_PATH,
+						   g_dbus_node_info_lookup_interface (introspection_data,
+										      GS_STATS_INTERFACE),
+						   &gs_listener_vtable,
+						   listener,
+						   NULL,
+						   &local_error);
+	if (listener->priv->stats_registration_id == 0) {
+		g_warning ("Couldn't export the %s interface: %s",
+			   GS_STATS_INTERFACE, local_error->message);
+		g_clear_error (&local_error);
+	}
+
+	/* The reply arrives on the main loop; losing the name there,
+	 * before or after we got it, shuts the daemon down */
+	listener->priv->name_id = g_bus_own_name_on_connection (listener->priv->connection,
+								GS_SERVICE,
+								G_BUS_NAME_OWNER_FLAGS_REPLACE,
+								listener_name_acquired_cb,
+								listener_name_lost_cb,
+								listener,
+								NULL);
+
+	/* inhibitors go away with the client that took them */
+	listener->priv->name_owner_id =
+		g_dbus_connection_signal_subscribe (listener->priv->connection,
+						    DBUS_SERVICE,
+						    DBUS_INTERFACE,
+						    "NameOwnerChanged",
+						    DBUS_PATH,
+						    NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    listener_name_owner_changed,
+						    listener,
+						    NULL);
 
-	if (dbus_connection_register_object_path (listener->priv->connection,
-						  GS_PATH,
-						  &gs_listener_vtable,
-						  listener) == FALSE) {
-		g_critical ("out of memory registering object path");
-		return FALSE;
+	return TRUE;
+}
+
+static void
+listener_unregister (GSListener *listener)
+{
+	if (listener->priv->name_id > 0) {
+		g_bus_unown_name (listener->priv->name_id);
+		listener->priv->name_id = 0;
 	}
+	listener->priv->name_acquired = FALSE;
 
-	res = dbus_bus_request_name (listener->priv->connection, GS_SERVICE, DBUS_NAME_FLAG_REPLACE_EXISTING, &buserror);
-	if (dbus_error_is_set (&buserror)) {
-		g_set_error (error,
-			     GS_LISTENER_ERROR,
-			     GS_LISTENER_ERROR_ACQUISITION_FAILURE,
-			     "%s",
-			     buserror.message);
+	if (listener->priv->registration_id > 0) {
+		g_dbus_connection_unregister_object (listener->priv->connection,
+						     listener->priv->registration_id);
+		listener->priv->registration_id = 0;
 	}
-	if (res == DBUS_REQUEST_NAME_REPLY_EXISTS) {
-		g_set_error (error,
-			     GS_LISTENER_ERROR,
-			     GS_LISTENER_ERROR_ACQUISITION_FAILURE,
-			     "%s",
-			     _("screensaver already running in this session"));
-		return FALSE;
+	if (listener->priv->stats_registration_id > 0) {
+		g_dbus_connection_unregister_object (listener->priv->connection,
+						     listener->priv->stats_registration_id);
+		listener->priv->stats_registration_id = 0;
+	}
+	if (listener->priv->name_owner_id > 0) {
+		g_dbus_connection_signal_unsubscribe (listener->priv->connection,
+						      listener->priv->name_owner_id);
+		listener->priv->name_owner_id = 0;
+	}
+}
+
+static void
+listener_system_setup (GSListener *listener)
+{
+#ifdef WITH_SYSTEMD
+	if (listener->priv->have_systemd) {
+		listener_subscribe_system_signal (listener, SYSTEM_SIGNAL_SLEEP,
+						  SYSTEMD_LOGIND_SERVICE,
+						  SYSTEMD_LOGIND_PATH,
+						  SYSTEMD_LOGIND_INTERFACE,
+						  "PrepareForSleep",
+						  NULL);
+		listener_query_inhibit_delay_max (listener);
+		listener_take_sleep_inhibitor (listener);
 	}
+#endif
 
-	dbus_error_free (&buserror);
+	listener_subscribe_session_signals (listener);
+}
 
-	dbus_connection_add_filter (listener->priv->connection, listener_dbus_filter_function, listener, NULL);
+static void
+listener_system_teardown (GSListener *listener)
+{
+	guint i;
 
-	dbus_bus_add_match (listener->priv->connection,
-			    "type='signal'"
-			    ",interface='"DBUS_INTERFACE_DBUS"'"
-			    ",sender='"DBUS_SERVICE_DBUS"'"
-			    ",member='NameLost'",
-			    NULL);
+	for (i = 0; i < N_SYSTEM_SUBSCRIPTIONS; i++) {
+		if (listener->priv->system_subscriptions [i] > 0) {
+			g_dbus_connection_signal_unsubscribe (listener->priv->system_connection,
+							      listener->priv->system_subscriptions [i]);
+			listener->priv->system_subscriptions [i] = 0;
+		}
+	}
 
-	if (listener->priv->system_connection != NULL) {
-		dbus_connection_add_filter (listener->priv->system_connection,
-					    listener_dbus_system_filter_function,
-					    listener,
-					    NULL);
-#ifdef WITH_SYSTEMD
-		if (listener->priv->have_systemd) {
-			dbus_bus_add_match (listener->priv->system_connection,
-					    "type='signal'"
-					    ",sender='"SYSTEMD_LOGIND_SERVICE"'"
-					    ",interface='"SYSTEMD_LOGIND_SESSION_INTERFACE"'"
-					    ",member='Unlock'",
-					    NULL);
-			dbus_bus_add_match (listener->priv->system_connection,
-					    "type='signal'"
-					    ",sender='"SYSTEMD_LOGIND_SERVICE"'"
-					    ",interface='"SYSTEMD_LOGIND_SESSION_INTERFACE"'"
-					    ",member='Lock'",
-					    NULL);
-			dbus_bus_add_match (listener->priv->system_connection,
-					    "type='signal'"
-					    ",sender='"SYSTEMD_LOGIND_SERVICE"'"
-					    ",interface='"DBUS_INTERFACE_PROPERTIES"'"
-					    ",member='PropertiesChanged'",
-					    NULL);
-			dbus_bus_add_match (listener->priv->system_connection,
-					    "type='signal'"
-					    ",sender='"SYSTEMD_LOGIND_SERVICE"'"
-					    ",interface='"SYSTEMD_LOGIND_INTERFACE"'"
-					    ",member='PrepareForSleep'",
-					    NULL);
-
-			return (res != -1);
+	g_dbus_connection_remove_filter (listener->priv->system_connection,
+					 listener->priv->system_filter_id);
+	listener->priv->system_filter_id = 0;
+
+	g_clear_object (&listener->priv->system_connection);
+}
+
+/* Whatever has to be on the buses is set up here if they are already
+ * connected, and otherwise as soon as they are */
+gboolean
+gs_listener_acquire (GSListener *listener,
+		     GError    **error)
+{
+	g_return_val_if_fail (listener != NULL, FALSE);
+
+	listener->priv->acquired = TRUE;
+
+	if (listener->priv->connection != NULL) {
+		if (! listener_register (listener, error)) {
+			return FALSE;
 		}
-#endif
+	}
+
+	if (listener->priv->system_connection != NULL) {
+		listener_system_setup (listener);
+	}
+
+	return TRUE;
+}
 
 #ifdef WITH_CONSOLE_KIT
-		dbus_bus_add_match (listener->priv->system_connection,
-				    "type='signal'"
-				    ",interface='"CK_SESSION_INTERFACE"'"
-				    ",member='Unlock'",
-				    NULL);
-		dbus_bus_add_match (listener->priv->system_connection,
-				    "type='signal'"
-				    ",interface='"CK_SESSION_INTERFACE"'"
-				    ",member='Lock'",
-				    NULL);
-		dbus_bus_add_match (listener->priv->system_connection,
-				    "type='signal'"
-				    ",interface='"CK_SESSION_INTERFACE"'"
-				    ",member='ActiveChanged'",
-				    NULL);
-#endif
+static void
+query_session_id_cb (GObject      *source,
+		     GAsyncResult *result,
+		     gpointer      user_data)
+{
+	GSListener *listener;
+	GVariant   *reply;
+	GError     *error;
+
+	error = NULL;
+	reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+	if (reply == NULL) {
+		if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			gs_debug ("GetCurrentSession raised:\n %s\n\n", error->message);
+		}
+		g_error_free (error);
+		return;
 	}
 
-	return (res != -1);
+	listener = GS_LISTENER (user_data);
+
+	g_free (listener->priv->session_id);
+	g_variant_get (reply, "(o)", &listener->priv->session_id);
+	g_variant_unref (reply);
+
+	gs_debug ("Got session-id: %s", listener->priv->session_id);
+
+	/* ConsoleKit hands out the session's object path as its id */
+	g_free (listener->priv->session_path);
+	listener->priv->session_path = g_strdup (listener->priv->session_id);
+
+	listener_subscribe_session_signals (listener);
 }
+#endif
 
 static char *
 query_session_id (GSListener *listener)
 {
-	DBusMessage    *message;
-	DBusMessage    *reply;
-	DBusError       error;
-	DBusMessageIter reply_iter;
-	char           *ssid;
-
 	if (listener->priv->system_connection == NULL) {
 		gs_debug ("No connection to the system bus");
 		return NULL;
 	}
 
-	ssid = NULL;
-
-	dbus_error_init (&error);
-
 #ifdef WITH_SYSTEMD
 	if (listener->priv->have_systemd) {
+		char *ssid;
 		char *t;
 		int r;
 
@@ -1447,34 +2268,50 @@ query_session_id (GSListener *listener)
 #endif
 
 #ifdef WITH_CONSOLE_KIT
-	message = dbus_message_new_method_call (CK_SERVICE, CK_MANAGER_PATH, CK_MANAGER_INTERFACE, "GetCurrentSession");
-	if (message == NULL) {
-		gs_debug ("Couldn't allocate the dbus message");
-		return NULL;
-	}
+	/* the answer is filled in by query_session_id_cb */
+	g_dbus_connection_call (listener->priv->system_connection,
+				CK_SERVICE,
+				CK_MANAGER_PATH,
+				CK_MANAGER_INTERFACE,
+				"GetCurrentSession",
+				NULL,
+				G_VARIANT_TYPE ("(o)"),
+				G_DBUS_CALL_FLAGS_NONE,
+				-1,
+				listener->priv->cancellable,
+				query_session_id_cb,
+				listener);
+#endif
+
+	return NULL;
+}
 
-	/* FIXME: use async? */
-	reply = dbus_connection_send_with_reply_and_block (listener->priv->system_connection,
-							   message,
-							   -1, &error);
-	dbus_message_unref (message);
+#ifdef WITH_SYSTEMD
+/* logind exports each session under its id, escaped the same way
+ * as sd_bus_path_encode() does it */
+static char *
+logind_session_path (const char *session_id)
+{
+	GString    *path;
+	const char *p;
 
-	if (dbus_error_is_set (&error)) {
-		gs_debug ("%s raised:\n %s\n\n", error.name, error.message);
-		dbus_error_free (&error);
-		return NULL;
-	}
+	path = g_string_new (SYSTEMD_LOGIND_SESSION_PATH "/");
 
-	dbus_message_iter_init (reply, &reply_iter);
-	dbus_message_iter_get_basic (&reply_iter, &ssid);
+	if (*session_id == '\0') {
+		g_string_append_c (path, '_');
+	}
 
-	dbus_message_unref (reply);
+	for (p = session_id; *p != '\0'; p++) {
+		if (g_ascii_isalpha (*p) || (g_ascii_isdigit (*p) && p != session_id)) {
+			g_string_append_c (path, *p);
+		} else {
+			g_string_append_printf (path, "_%02x", (guchar) *p);
+		}
+	}
 
-	return g_strdup (ssid);
-#else
-	return NULL;
-#endif
+	return g_string_free (path, FALSE);
 }
+#endif
 
 static void
 init_session_id (GSListener *listener)
@@ -1482,6 +2319,77 @@ init_session_id (GSListener *listener)
 	g_free (listener->priv->session_id);
 	listener->priv->session_id = query_session_id (listener);
 	gs_debug ("Got session-id: %s", listener->priv->session_id);
+
+#ifdef WITH_SYSTEMD
+	if (listener->priv->have_systemd && listener->priv->session_id != NULL) {
+		g_free (listener->priv->session_path);
+		listener->priv->session_path = logind_session_path (listener->priv->session_id);
+	}
+#endif
+}
+
+static void
+listener_session_connected (GDBusConnection *connection,
+			    gpointer         user_data)
+{
+	GSListener *listener = GS_LISTENER (user_data);
+	GError     *error;
+
+	listener->priv->connection = g_object_ref (connection);
+
+	if (! listener->priv->acquired) {
+		return;
+	}
+
+	error = NULL;
+	if (! listener_register (listener, &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+	}
+}
+
+static void
+listener_session_lost (GDBusConnection *connection,
+		       gpointer         user_data)
+{
+	(void) connection;
+
+	GSListener *listener = GS_LISTENER (user_data);
+
+	listener_unregister (listener);
+	g_clear_object (&listener->priv->connection);
+
+	/* whoever held these was on the bus we just lost */
+	listener_clear_ref_entries (listener);
+}
+
+static void
+listener_system_connected (GDBusConnection *connection,
+			   gpointer         user_data)
+{
+	GSListener *listener = GS_LISTENER (user_data);
+
+	listener->priv->system_connection = g_object_ref (connection);
+	listener->priv->system_filter_id =
+		g_dbus_connection_add_filter (connection,
+					      listener_system_filter,
+					      listener,
+					      NULL);
+
+	init_session_id (listener);
+
+	if (listener->priv->acquired) {
+		listener_system_setup (listener);
+	}
+}
+
+static void
+listener_system_lost (GDBusConnection *connection,
+		      gpointer         user_data)
+{
+	(void) connection;
+
+	listener_system_teardown (GS_LISTENER (user_data));
 }
 
 static void
@@ -1489,14 +2397,35 @@ gs_listener_init (GSListener *listener)
 {
 	listener->priv = gs_listener_get_instance_private (listener);
 
+	listener->priv->cancellable = g_cancellable_new ();
+
+	/* cookie -> GSListenerRefEntry, and unique name -> entry count */
+	listener->priv->inhibitors = g_hash_table_new_full (NULL,
+							   NULL,
+							   NULL,
+							   (GDestroyNotify) listener_ref_entry_free);
+	listener->priv->clients = g_hash_table_new_full (g_str_hash,
+							g_str_equal,
+							g_free,
+							NULL);
+
 #ifdef WITH_SYSTEMD
 	/* check if logind is running */
 	listener->priv->have_systemd = (access("/run/systemd/seats/", F_OK) >= 0);
-#endif
 
-	gs_listener_dbus_init (listener);
+	listener->priv->sleep_inhibit_fd = -1;
+	listener->priv->inhibit_delay_max = DEFAULT_INHIBIT_DELAY_MAX;
+#endif
 
-	init_session_id (listener);
+	/* both connect in the background and come back by themselves */
+	listener->priv->session_watch_id = gs_bus_watch (G_BUS_TYPE_SESSION,
+							 listener_session_connected,
+							 listener_session_lost,
+							 listener);
+	listener->priv->system_watch_id = gs_bus_watch (G_BUS_TYPE_SYSTEM,
+							listener_system_connected,
+							listener_system_lost,
+							listener);
 }
 
 static void
@@ -1511,7 +2440,40 @@ gs_listener_finalize (GObject *object)
 
 	g_return_if_fail (listener->priv != NULL);
 
+	g_cancellable_cancel (listener->priv->cancellable);
+	g_object_unref (listener->priv->cancellable);
+
+	gs_bus_unwatch (listener->priv->session_watch_id);
+	gs_bus_unwatch (listener->priv->system_watch_id);
+
+	if (listener->priv->connection != NULL) {
+		listener_unregister (listener);
+		g_clear_object (&listener->priv->connection);
+	}
+
+	if (listener->priv->system_connection != NULL) {
+		listener_system_teardown (listener);
+	}
+
+	if (listener->priv->active_changed_id > 0) {
+		g_source_remove (listener->priv->active_changed_id);
+		listener->priv->active_changed_id = 0;
+	}
+
+#ifdef WITH_SYSTEMD
+	if (listener->priv->sleep_timeout_id > 0) {
+		g_source_remove (listener->priv->sleep_timeout_id);
+		listener->priv->sleep_timeout_id = 0;
+	}
+
+	listener_release_sleep_inhibitor (listener);
+#endif
+
+	g_hash_table_destroy (listener->priv->inhibitors);
+	g_hash_table_destroy (listener->priv->clients);
+
 	g_free (listener->priv->session_id);
+	g_free (listener->priv->session_path);
 
 	G_OBJECT_CLASS (gs_listener_parent_class)->finalize (object);
 }
@@ -70,6 +70,8 @@ gboolean gs_listener_set_active(GSListener* listener, gboolean active);
 gboolean gs_listener_set_session_idle(GSListener* listener, gboolean idle);
 void gs_listener_set_activation_enabled(GSListener* listener, gboolean enabled);
 gboolean gs_listener_get_activation_enabled(GSListener* listener);
+void gs_listener_set_lock_active(GSListener* listener, gboolean lock_active);
+void gs_listener_activation_finished(GSListener* listener);
 
 G_END_DECLS
 
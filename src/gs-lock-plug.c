@@ -41,6 +41,9 @@
 
 #include "gs-lock-plug.h"
 
+#include "gs-key-queue.h"
+#include "gs-secure-buffer.h"
+#include "gs-secure-entry-buffer.h"
 #include "gs-debug.h"
 
 #define INPUT_SOURCES_SCHEMA "org.gnome.desktop.input-sources"
@@ -100,7 +103,12 @@ struct _GSLockPlugPrivate
 	guint        auth_check_idle_id;
 	guint        response_idle_id;
 
-	GList       *key_events;
+	GSKeyQueue   key_queue;
+
+	GSSecureBuffer *typeahead;
+	gboolean     typeahead_submit;
+
+	gint64       prompt_asked_time;
 };
 
 typedef struct _ResponseData ResponseData;
@@ -286,6 +294,16 @@ response_cancel_idle_cb (GSLockPlug *plug)
 	return FALSE;
 }
 
+static gboolean
+response_ok_idle_cb (GSLockPlug *plug)
+{
+	plug->priv->response_idle_id = 0;
+
+	gs_lock_plug_response (plug, GS_LOCK_PLUG_RESPONSE_OK);
+
+	return FALSE;
+}
+
 static gboolean
 dialog_timed_out (GSLockPlug *plug)
 {
@@ -359,25 +377,42 @@ restart_cancel_timeout (GSLockPlug *plug)
 						       plug);
 }
 
-void
-gs_lock_plug_get_text (GSLockPlug *plug,
-		       char      **text)
+/* Moves what was typed into text, in the locale's encoding, and
+ * empties the entry.  The entry keeps its text in a secure buffer and
+ * wipes it as it goes, so in a UTF-8 locale the password is never
+ * anywhere else.
+ */
+gboolean
+gs_lock_plug_get_text (GSLockPlug     *plug,
+		       GSSecureBuffer *text)
 {
 	const char *typed_text;
-	char       *null_text;
 	char       *local_text;
+	gsize       len;
+	gboolean    ret;
+
+	g_return_val_if_fail (GS_IS_LOCK_PLUG (plug), FALSE);
+	g_return_val_if_fail (text != NULL, FALSE);
 
 	typed_text = gtk_entry_get_text (GTK_ENTRY (plug->priv->auth_prompt_entry));
-	local_text = g_locale_from_utf8 (typed_text, strlen (typed_text), NULL, NULL, NULL);
 
-	null_text = g_strnfill (strlen (typed_text) + 1, '\b');
-	gtk_entry_set_text (GTK_ENTRY (plug->priv->auth_prompt_entry), null_text);
-	gtk_entry_set_text (GTK_ENTRY (plug->priv->auth_prompt_entry), "");
-	g_free (null_text);
+	gs_secure_buffer_clear (text);
 
-	if (text != NULL) {
-		*text = local_text;
+	if (g_get_charset (NULL)) {
+		ret = gs_secure_buffer_append (text, typed_text, -1);
+	} else {
+		local_text = g_locale_from_utf8 (typed_text, -1, NULL, &len, NULL);
+		ret = local_text != NULL && gs_secure_buffer_append (text, local_text, len);
+
+		if (local_text != NULL) {
+			gs_secure_zero (local_text, len);
+			g_free (local_text);
+		}
 	}
+
+	gtk_entry_set_text (GTK_ENTRY (plug->priv->auth_prompt_entry), "");
+
+	return ret;
 }
 
 typedef struct
@@ -458,6 +493,20 @@ run_keymap_handler (GdkKeymap *keymap,
 	kbd_lock_mode_update (plug, get_kbd_lock_mode ());
 }
 
+/* Makes a running gs_lock_plug_run() return GS_LOCK_PLUG_RESPONSE_NONE,
+ * for when whatever was asked is no longer needed.
+ */
+void
+gs_lock_plug_interrupt (GSLockPlug *plug)
+{
+	g_return_if_fail (GS_IS_LOCK_PLUG (plug));
+
+	g_signal_emit (plug,
+		       lock_plug_signals [RESPONSE],
+		       0,
+		       GS_LOCK_PLUG_RESPONSE_NONE);
+}
+
 /* adapted from GTK+ gtkdialog.c */
 int
 gs_lock_plug_run (GSLockPlug *plug)
@@ -541,24 +590,6 @@ gs_lock_plug_run (GSLockPlug *plug)
 }
 
 
-static cairo_surface_t *
-surface_from_pixbuf (GdkPixbuf *pixbuf)
-{
-	cairo_surface_t *surface;
-	cairo_t         *cr;
-
-	surface = cairo_image_surface_create (gdk_pixbuf_get_has_alpha (pixbuf) ?
-					      CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
-					      gdk_pixbuf_get_width (pixbuf),
-					      gdk_pixbuf_get_height (pixbuf));
-	cr = cairo_create (surface);
-	gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
-	cairo_paint (cr);
-	cairo_destroy (cr);
-
-	return surface;
-}
-
 static void
 rounded_rectangle (cairo_t *cr,
 		   gdouble  aspect,
@@ -602,115 +633,15 @@ rounded_rectangle (cairo_t *cr,
 	cairo_close_path (cr);
 }
 
-/* copied from gdm-user.c */
-
-/**
- * go_cairo_convert_data_to_pixbuf:
- * @src: a pointer to pixel data in cairo format
- * @dst: a pointer to pixel data in pixbuf format
- * @width: image width
- * @height: image height
- * @rowstride: data rowstride
- *
- * Converts the pixel data stored in @src in CAIRO_FORMAT_ARGB32 cairo format
- * to GDK_COLORSPACE_RGB pixbuf format and move them
- * to @dst. If @src == @dst, pixel are converted in place.
- **/
-
-static void
-go_cairo_convert_data_to_pixbuf (unsigned char *dst,
-				 unsigned char const *src,
-				 int width,
-				 int height,
-				 int rowstride)
-{
-	int i,j;
-	unsigned int t;
-	unsigned char a, b, c;
-
-	g_return_if_fail (dst != NULL);
-
-#define MULT(d,c,a,t) G_STMT_START { t = (a)? c * 255 / a: 0; d = t;} G_STMT_END
-
-	if (src == dst || src == NULL) {
-		for (i = 0; i < height; i++) {
-			for (j = 0; j < width; j++) {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-				MULT(a, dst[2], dst[3], t);
-				MULT(b, dst[1], dst[3], t);
-				MULT(c, dst[0], dst[3], t);
-				dst[0] = a;
-				dst[1] = b;
-				dst[2] = c;
-#else
-				MULT(a, dst[1], dst[0], t);
-				MULT(b, dst[2], dst[0], t);
-				MULT(c, dst[3], dst[0], t);
-				dst[3] = dst[0];
-				dst[0] = a;
-				dst[1] = b;
-				dst[2] = c;
-#endif
-				dst += 4;
-			}
-			dst += rowstride - width * 4;
-		}
-	} else {
-		for (i = 0; i < height; i++) {
-			for (j = 0; j < width; j++) {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-				MULT(dst[0], src[2], src[3], t);
-				MULT(dst[1], src[1], src[3], t);
-				MULT(dst[2], src[0], src[3], t);
-				dst[3] = src[3];
-#else
-				MULT(dst[0], src[1], src[0], t);
-				MULT(dst[1], src[2], src[0], t);
-				MULT(dst[2], src[3], src[0], t);
-				dst[3] = src[0];
-#endif
-				src += 4;
-				dst += 4;
-			}
-			src += rowstride - width * 4;
-			dst += rowstride - width * 4;
-		}
-	}
-#undef MULT
-}
-
-static void
-cairo_to_pixbuf (guint8    *src_data,
-		 GdkPixbuf *dst_pixbuf)
-{
-	unsigned char *src;
-	unsigned char *dst;
-	guint          w;
-	guint          h;
-	guint          rowstride;
-
-	w = gdk_pixbuf_get_width (dst_pixbuf);
-	h = gdk_pixbuf_get_height (dst_pixbuf);
-	rowstride = gdk_pixbuf_get_rowstride (dst_pixbuf);
-
-	dst = gdk_pixbuf_get_pixels (dst_pixbuf);
-	src = src_data;
-
-	go_cairo_convert_data_to_pixbuf (dst, src, w, h, rowstride);
-}
-
-static GdkPixbuf *
-frame_pixbuf (GdkPixbuf *source)
+static cairo_surface_t *
+frame_surface (GdkPixbuf *source)
 {
-	GdkPixbuf       *dest;
 	cairo_t         *cr;
 	cairo_surface_t *surface;
 	guint            w;
 	guint            h;
-	guint            rowstride;
 	int              frame_width;
 	double           radius;
-	guint8          *data;
 
 	frame_width = 5;
 
@@ -718,28 +649,9 @@ frame_pixbuf (GdkPixbuf *source)
 	h = gdk_pixbuf_get_height (source) + frame_width * 2;
 	radius = w / 10;
 
-	dest = gdk_pixbuf_new (GDK_COLORSPACE_RGB,
-			       TRUE,
-			       8,
-			       w,
-			       h);
-	rowstride = gdk_pixbuf_get_rowstride (dest);
-
-
-	data = g_new0 (guint8, h * rowstride);
-
-	surface = cairo_image_surface_create_for_data (data,
-						       CAIRO_FORMAT_ARGB32,
-						       w,
-						       h,
-						       rowstride);
+	/* new image surfaces start out fully transparent */
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, w, h);
 	cr = cairo_create (surface);
-	cairo_surface_destroy (surface);
-
-	/* set up image */
-	cairo_rectangle (cr, 0, 0, w, h);
-	cairo_set_source_rgba (cr, 1.0, 1.0, 1.0, 0.0);
-	cairo_fill (cr);
 
 	rounded_rectangle (cr,
 			   1.0,
@@ -751,34 +663,199 @@ frame_pixbuf (GdkPixbuf *source)
 	cairo_set_source_rgba (cr, 0.5, 0.5, 0.5, 0.3);
 	cairo_fill_preserve (cr);
 
-	surface = surface_from_pixbuf (source);
-	cairo_set_source_surface (cr, surface, frame_width, frame_width);
+	gdk_cairo_set_source_pixbuf (cr, source, frame_width, frame_width);
 	cairo_fill (cr);
-	cairo_surface_destroy (surface);
-
-	cairo_to_pixbuf (data, dest);
 
 	cairo_destroy (cr);
-	g_free (data);
 
-	return dest;
+	return surface;
+}
+
+/* The framed face is cached in the runtime dir so that later dialogs can
+ * map it straight back in instead of decoding the icon and framing it
+ * again.  The file holds a FaceCacheHeader, the icon path it was made
+ * from and then the framed face as native endian CAIRO_FORMAT_ARGB32
+ * rows.  It is only used while the accounts service still reports that
+ * same path and the file there is unchanged. */
+#define FACE_CACHE_MAGIC    0x46534742
+#define FACE_CACHE_VERSION  2
+#define FACE_CACHE_MAX_SIZE 1024
+
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	gint64  icon_mtime;
+	gint64  icon_size;
+	guint32 width;
+	guint32 height;
+	guint32 path_len;
+	guint32 data_offset;
+} FaceCacheHeader;
+
+static const cairo_user_data_key_t face_cache_key;
+
+static char *
+face_cache_get_filename (void)
+{
+	return g_build_filename (g_get_user_runtime_dir (),
+				 "budgie-screensaver",
+				 "face-cache",
+				 NULL);
 }
 
-/* end copied from gdm-user.c */
+static cairo_surface_t *
+face_cache_load (const char *icon_file)
+{
+	char            *filename;
+	GMappedFile     *file;
+	char            *contents;
+	gsize            length;
+	FaceCacheHeader  header;
+	GStatBuf         buf;
+	int              stride;
+	cairo_surface_t *surface;
+
+	surface = NULL;
+
+	/* mapped privately and writable so cairo is handed ordinary memory,
+	 * nothing is ever written back to the file */
+	filename = face_cache_get_filename ();
+	file = g_mapped_file_new (filename, TRUE, NULL);
+	g_free (filename);
+
+	if (file == NULL) {
+		return NULL;
+	}
+
+	contents = g_mapped_file_get_contents (file);
+	length = g_mapped_file_get_length (file);
+
+	if (contents == NULL || length < sizeof (header)) {
+		goto out;
+	}
+
+	memcpy (&header, contents, sizeof (header));
+
+	if (header.magic != FACE_CACHE_MAGIC
+	    || header.version != FACE_CACHE_VERSION
+	    || header.width == 0 || header.width > FACE_CACHE_MAX_SIZE
+	    || header.height == 0 || header.height > FACE_CACHE_MAX_SIZE
+	    || header.path_len == 0
+	    || header.data_offset % 8 != 0
+	    || header.data_offset < sizeof (header) + (gsize) header.path_len
+	    || header.data_offset > length) {
+		gs_debug ("Ignoring invalid face cache");
+		goto out;
+	}
+
+	stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, header.width);
+	if (length - header.data_offset != (gsize) stride * header.height) {
+		gs_debug ("Ignoring truncated face cache");
+		goto out;
+	}
+
+	/* the user may have picked an icon at another path since */
+	if (header.path_len != strlen (icon_file)
+	    || memcmp (contents + sizeof (header), icon_file, header.path_len) != 0) {
+		gs_debug ("Face cache is for another icon than %s", icon_file);
+		goto out;
+	}
+
+	if (g_stat (icon_file, &buf) != 0
+	    || (gint64) buf.st_mtime != header.icon_mtime
+	    || (gint64) buf.st_size != header.icon_size) {
+		gs_debug ("Face cache for %s is out of date", icon_file);
+		goto out;
+	}
+
+	surface = cairo_image_surface_create_for_data ((unsigned char *) contents + header.data_offset,
+						       CAIRO_FORMAT_ARGB32,
+						       header.width,
+						       header.height,
+						       stride);
+	if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy (surface);
+		surface = NULL;
+		goto out;
+	}
+
+	/* the surface keeps the mapping alive */
+	cairo_surface_set_user_data (surface,
+				     &face_cache_key,
+				     g_mapped_file_ref (file),
+				     (cairo_destroy_func_t) g_mapped_file_unref);
+
+ out:
+	g_mapped_file_unref (file);
+
+	return surface;
+}
 
 static void
-image_set_from_pixbuf (GtkImage  *image,
-		       GdkPixbuf *source)
-{
-	GdkPixbuf *pixbuf;
+face_cache_save (const char      *icon_file,
+		 cairo_surface_t *surface)
+{
+	char            *filename;
+	char            *dirname;
+	GByteArray      *data;
+	FaceCacheHeader  header;
+	GStatBuf         buf;
+	GError          *error;
+
+	if (cairo_image_surface_get_format (surface) != CAIRO_FORMAT_ARGB32
+	    || cairo_image_surface_get_width (surface) > FACE_CACHE_MAX_SIZE
+	    || cairo_image_surface_get_height (surface) > FACE_CACHE_MAX_SIZE
+	    || cairo_image_surface_get_stride (surface) != cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32,
+											 cairo_image_surface_get_width (surface))) {
+		return;
+	}
 
-	pixbuf = frame_pixbuf (source);
-	gtk_image_set_from_pixbuf (image, pixbuf);
-	g_object_unref (pixbuf);
+	if (g_stat (icon_file, &buf) != 0) {
+		return;
+	}
+
+	cairo_surface_flush (surface);
+
+	memset (&header, 0, sizeof (header));
+	header.magic = FACE_CACHE_MAGIC;
+	header.version = FACE_CACHE_VERSION;
+	header.icon_mtime = buf.st_mtime;
+	header.icon_size = buf.st_size;
+	header.width = cairo_image_surface_get_width (surface);
+	header.height = cairo_image_surface_get_height (surface);
+	header.path_len = strlen (icon_file);
+	/* keep the pixels word aligned in the mapping */
+	header.data_offset = (sizeof (header) + header.path_len + 7) & ~7;
+
+	data = g_byte_array_sized_new (header.data_offset + cairo_image_surface_get_stride (surface) * header.height);
+	g_byte_array_append (data, (const guint8 *) &header, sizeof (header));
+	g_byte_array_append (data, (const guint8 *) icon_file, header.path_len);
+	g_byte_array_set_size (data, header.data_offset);
+	memset (data->data + sizeof (header) + header.path_len,
+		0,
+		header.data_offset - sizeof (header) - header.path_len);
+	g_byte_array_append (data,
+			     cairo_image_surface_get_data (surface),
+			     cairo_image_surface_get_stride (surface) * header.height);
+
+	filename = face_cache_get_filename ();
+	dirname = g_path_get_dirname (filename);
+
+	error = NULL;
+	if (g_mkdir_with_parents (dirname, 0700) != 0) {
+		gs_debug ("Unable to create %s: %s", dirname, g_strerror (errno));
+	} else if (! g_file_set_contents (filename, (const char *) data->data, data->len, &error)) {
+		gs_debug ("Unable to write face cache: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_byte_array_unref (data);
 }
 
-static GdkPixbuf *
-get_pixbuf_of_user_icon (GSLockPlug *plug)
+static char *
+get_user_icon_file (GSLockPlug *plug)
 {
 	(void) plug;
 
@@ -788,8 +865,7 @@ get_pixbuf_of_user_icon (GSLockPlug *plug)
 	const char      *user;
 	GVariant        *get_icon_file_reply;
 	GVariant        *icon_file_variant;
-	const char      *icon_file;
-	GdkPixbuf       *pixbuf;
+	char            *icon_file;
 
 	error = NULL;
 	system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
@@ -818,9 +894,7 @@ get_pixbuf_of_user_icon (GSLockPlug *plug)
 		return NULL;
 	}
 
-	user = g_variant_get_string (g_variant_get_child_value (find_user_by_name_reply,
-								0),
-				     NULL);
+	g_variant_get (find_user_by_name_reply, "(&o)", &user);
 
 	get_icon_file_reply = g_dbus_connection_call_sync (system_bus,
 							   "org.freedesktop.Accounts",
@@ -845,48 +919,78 @@ get_pixbuf_of_user_icon (GSLockPlug *plug)
 
 	g_variant_get_child (get_icon_file_reply, 0, "v", &icon_file_variant);
 
-	icon_file = g_variant_get_string (icon_file_variant, NULL);
-
-	if (icon_file == NULL) {
+	if (g_variant_is_of_type (icon_file_variant, G_VARIANT_TYPE_STRING)) {
+		icon_file = g_variant_dup_string (icon_file_variant, NULL);
+	} else {
 		char *string;
 
 		string = g_variant_print (get_icon_file_reply, TRUE);
 		g_warning ("reply for user icon path returned invalid response '%s'", string);
 		g_free (string);
 
-		pixbuf = NULL;
-	} else {
-		pixbuf = gdk_pixbuf_new_from_file_at_size (icon_file,
-							   64,
-							   64,
-							   &error);
+		icon_file = NULL;
 	}
 	g_variant_unref (icon_file_variant);
 	g_variant_unref (get_icon_file_reply);
 
+	return icon_file;
+}
+
+static cairo_surface_t *
+get_surface_of_user_icon (GSLockPlug *plug)
+{
+	GError          *error;
+	char            *icon_file;
+	GdkPixbuf       *source;
+	cairo_surface_t *surface;
+
+	icon_file = get_user_icon_file (plug);
+	if (icon_file == NULL || icon_file[0] == '\0') {
+		g_free (icon_file);
+		return NULL;
+	}
+
+	surface = face_cache_load (icon_file);
+	if (surface != NULL) {
+		g_free (icon_file);
+		return surface;
+	}
+
+	error = NULL;
+	source = gdk_pixbuf_new_from_file_at_size (icon_file,
+						   64,
+						   64,
+						   &error);
 	if (error != NULL) {
 		g_warning ("Couldn't load user icon: %s", error->message);
 		g_error_free (error);
+		g_free (icon_file);
 		return NULL;
 	}
 
-	return pixbuf;
+	surface = frame_surface (source);
+	g_object_unref (source);
+
+	face_cache_save (icon_file, surface);
+	g_free (icon_file);
+
+	return surface;
 }
 
 static gboolean
 set_face_image (GSLockPlug *plug)
 {
-	GdkPixbuf    *pixbuf;
+	cairo_surface_t *surface;
 
-	pixbuf = get_pixbuf_of_user_icon (plug);
+	surface = get_surface_of_user_icon (plug);
 
-	if (pixbuf == NULL) {
+	if (surface == NULL) {
 		return FALSE;
 	}
 
-	image_set_from_pixbuf (GTK_IMAGE (plug->priv->auth_face_image), pixbuf);
+	gtk_image_set_from_surface (GTK_IMAGE (plug->priv->auth_face_image), surface);
 
-	g_object_unref (pixbuf);
+	cairo_surface_destroy (surface);
 
 	return TRUE;
 }
@@ -929,27 +1033,107 @@ static void
 queue_key_event (GSLockPlug  *plug,
 		 GdkEventKey *event)
 {
-	GdkEvent *saved_event;
-
-	saved_event = gdk_event_copy ((GdkEvent *)event);
-	plug->priv->key_events = g_list_prepend (plug->priv->key_events,
-						 saved_event);
+	if (! gs_key_queue_push (&plug->priv->key_queue, event)) {
+		gs_debug ("Key queue is full, dropping key press");
+	}
 }
 
 static void
 forward_key_events (GSLockPlug *plug)
 {
-	plug->priv->key_events = g_list_reverse (plug->priv->key_events);
-	while (plug->priv->key_events != NULL) {
-		GdkEventKey *event = plug->priv->key_events->data;
+	gs_key_queue_forward (&plug->priv->key_queue, GTK_WINDOW (plug));
+}
 
-		gtk_window_propagate_key_event (GTK_WINDOW (plug), event);
+/* puts the text typed before the dialog was up in front of anything
+ * typed since, but only ever into a prompt that hides what it shows */
+static void
+maybe_insert_typeahead (GSLockPlug *plug)
+{
+	GtkEditable *editable;
+	int          position;
 
-		gdk_event_free ((GdkEvent *)event);
+	if (plug->priv->typeahead == NULL) {
+		return;
+	}
 
-		plug->priv->key_events = g_list_delete_link (plug->priv->key_events,
-							     plug->priv->key_events);
+	if (! gtk_widget_get_sensitive (plug->priv->auth_prompt_entry)
+	    || gtk_entry_get_visibility (GTK_ENTRY (plug->priv->auth_prompt_entry))) {
+		return;
 	}
+
+	editable = GTK_EDITABLE (plug->priv->auth_prompt_entry);
+	position = 0;
+	gtk_editable_insert_text (editable,
+				  gs_secure_buffer_get_data (plug->priv->typeahead),
+				  gs_secure_buffer_get_length (plug->priv->typeahead),
+				  &position);
+	gtk_editable_set_position (editable, -1);
+
+	if (plug->priv->typeahead_submit) {
+		remove_response_idle (plug);
+		plug->priv->response_idle_id = g_idle_add ((GSourceFunc)response_ok_idle_cb,
+							   plug);
+	}
+
+	gs_secure_buffer_free (plug->priv->typeahead);
+	plug->priv->typeahead = NULL;
+	plug->priv->typeahead_submit = FALSE;
+}
+
+void
+gs_lock_plug_set_typeahead (GSLockPlug *plug,
+			    const char *text,
+			    gboolean    submit)
+{
+	g_return_if_fail (GS_IS_LOCK_PLUG (plug));
+
+	if (text == NULL || text[0] == '\0') {
+		return;
+	}
+
+	if (plug->priv->typeahead == NULL) {
+		plug->priv->typeahead = gs_secure_buffer_new ();
+	}
+
+	gs_secure_buffer_clear (plug->priv->typeahead);
+	gs_secure_buffer_append (plug->priv->typeahead, text, -1);
+	plug->priv->typeahead_submit = submit;
+
+	/* the password prompt may already be waiting */
+	maybe_insert_typeahead (plug);
+}
+
+static void
+prompt_painted_cb (GdkFrameClock *clock,
+		   GSLockPlug    *plug)
+{
+	g_signal_handlers_disconnect_by_func (clock, prompt_painted_cb, plug);
+
+	gs_debug ("Prompt visible %" G_GINT64_FORMAT " us after PAM asked for it",
+		  g_get_monotonic_time () - plug->priv->prompt_asked_time);
+}
+
+/* Logs how long it takes from the auth worker getting a prompt to the
+ * first frame that shows it, asked_time is on the monotonic clock.
+ */
+void
+gs_lock_plug_trace_prompt (GSLockPlug *plug,
+			   gint64      asked_time)
+{
+	GdkFrameClock *clock;
+
+	g_return_if_fail (GS_IS_LOCK_PLUG (plug));
+
+	clock = gtk_widget_get_frame_clock (GTK_WIDGET (plug));
+	if (asked_time == 0 || clock == NULL) {
+		return;
+	}
+
+	plug->priv->prompt_asked_time = asked_time;
+
+	g_signal_handlers_disconnect_by_func (clock, prompt_painted_cb, plug);
+	g_signal_connect_object (clock, "after-paint",
+				 G_CALLBACK (prompt_painted_cb), plug, 0);
 }
 
 static void
@@ -1302,6 +1486,8 @@ gs_lock_plug_enable_prompt (GSLockPlug *plug,
 		gtk_widget_grab_focus (plug->priv->auth_prompt_entry);
 	}
 
+	maybe_insert_typeahead (plug);
+
 	/* were there any key events sent to the plug while the
 	 * entry wasnt ready? If so, forward them along
 	 */
@@ -1567,6 +1753,7 @@ create_page_one (GSLockPlug *plug)
 	GtkWidget            *vbox2;
 	GtkWidget            *hbox;
 	GtkWidget            *hbox2;
+	GtkEntryBuffer       *entry_buffer;
 
 	gs_profile_start ("page one");
 
@@ -1596,7 +1783,9 @@ create_page_one (GSLockPlug *plug)
 	gtk_box_pack_start (GTK_BOX (vbox2), plug->priv->auth_prompt_label, FALSE, FALSE, 0);
 
 	hbox2 = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
-	plug->priv->auth_prompt_entry = gtk_entry_new ();
+	entry_buffer = gs_secure_entry_buffer_new ();
+	plug->priv->auth_prompt_entry = gtk_entry_new_with_buffer (entry_buffer);
+	g_object_unref (entry_buffer);
 
 	gtk_label_set_mnemonic_widget (GTK_LABEL (plug->priv->auth_prompt_label),
 				       plug->priv->auth_prompt_entry);
@@ -1814,6 +2003,9 @@ gs_lock_plug_finalize (GObject *object)
 	remove_response_idle (plug);
 	remove_cancel_timeout (plug);
 
+	gs_key_queue_clear (&plug->priv->key_queue);
+	gs_secure_buffer_free (plug->priv->typeahead);
+
 	G_OBJECT_CLASS (gs_lock_plug_parent_class)->finalize (object);
 }
 
@@ -25,6 +25,8 @@
 
 #include <gtk/gtkx.h>
 
+#include "gs-secure-buffer.h"
+
 G_BEGIN_DECLS
 
 typedef enum {
@@ -62,13 +64,16 @@ GType gs_lock_plug_get_type(void);
 GtkWidget* gs_lock_plug_new(void);
 
 int gs_lock_plug_run(GSLockPlug* plug);
+void gs_lock_plug_interrupt(GSLockPlug* plug);
 void gs_lock_plug_set_sensitive(GSLockPlug* plug, gboolean sensitive);
 void gs_lock_plug_enable_prompt(GSLockPlug* plug, const char* message, gboolean visible);
 void gs_lock_plug_disable_prompt(GSLockPlug* plug);
 void gs_lock_plug_set_busy(GSLockPlug* plug);
 void gs_lock_plug_set_ready(GSLockPlug* plug);
 
-void gs_lock_plug_get_text(GSLockPlug* plug, char** text);
+gboolean gs_lock_plug_get_text(GSLockPlug* plug, GSSecureBuffer* text);
+void gs_lock_plug_set_typeahead(GSLockPlug* plug, const char* text, gboolean submit);
+void gs_lock_plug_trace_prompt(GSLockPlug* plug, gint64 asked_time);
 void gs_lock_plug_show_message(GSLockPlug* plug, const char* message);
 
 G_END_DECLS
@@ -22,7 +22,6 @@
 
 #include "config.h"
 
-#include <time.h>
 #include <gdk/gdk.h>
 #include <gdk/gdkx.h>
 
@@ -36,6 +35,7 @@
 #include "gs-grab.h"
 #include "gs-fade.h"
 #include "gs-debug.h"
+#include "gs-clock.h"
 
 static void gs_manager_class_init (GSManagerClass *klass);
 static void gs_manager_init       (GSManager      *manager);
@@ -67,8 +67,9 @@ struct _GSManagerPrivate
 
 	guint        fading : 1;
 	guint        dialog_up : 1;
+	guint        activated : 1;
 
-	time_t       activate_time;
+	gint64       activate_time;
 
 	guint        lock_timeout_id;
 
@@ -97,6 +98,7 @@ enum {
 	PROP_KEYBOARD_COMMAND,
 	PROP_STATUS_MESSAGE,
 	PROP_ACTIVE,
+	PROP_LOCK_ACTIVE,
 };
 
 #define FADE_TIMEOUT 250
@@ -133,6 +135,8 @@ gs_manager_set_lock_active (GSManager *manager,
 		for (l = manager->priv->windows; l; l = l->next) {
 			gs_window_set_lock_enabled (l->data, lock_active);
 		}
+
+		g_object_notify (G_OBJECT (manager), "lock-active");
 	}
 }
 
@@ -253,7 +257,7 @@ gs_manager_set_lock_timeout (GSManager *manager,
 		    && ! manager->priv->lock_active
 		    && (lock_timeout >= 0)) {
 
-			glong elapsed = (time (NULL) - manager->priv->activate_time) * 1000;
+			glong elapsed = (gs_clock_get_boottime () - manager->priv->activate_time) / 1000;
 
 			remove_lock_timer (manager);
 
@@ -426,6 +430,9 @@ gs_manager_get_property (GObject            *object,
 	case PROP_ACTIVE:
 		g_value_set_boolean (value, self->priv->active);
 		break;
+	case PROP_LOCK_ACTIVE:
+		g_value_set_boolean (value, self->priv->lock_active);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -489,6 +496,13 @@ gs_manager_class_init (GSManagerClass *klass)
 							       NULL,
 							       FALSE,
 							       G_PARAM_READABLE));
+	g_object_class_install_property (object_class,
+					 PROP_LOCK_ACTIVE,
+					 g_param_spec_boolean ("lock-active",
+							       NULL,
+							       NULL,
+							       FALSE,
+							       G_PARAM_READABLE));
 	g_object_class_install_property (object_class,
 					 PROP_LOCK_ENABLED,
 					 g_param_spec_boolean ("lock-enabled",
@@ -748,6 +762,40 @@ add_unfade_idle (GSManager *manager)
 	manager->priv->unfade_idle_id = g_timeout_add (500, (GSourceFunc)unfade_idle, manager);
 }
 
+/* "activated" goes out once per activation, when every window has
+ * been mapped and the seat is grabbed to one of them, so that nothing
+ * typed can reach the session any more */
+static void
+manager_maybe_emit_activated (GSManager *manager)
+{
+	GSList  *l;
+	gboolean grabbed;
+
+	if (manager->priv->activated || ! manager->priv->active) {
+		return;
+	}
+
+	grabbed = FALSE;
+	for (l = manager->priv->windows; l; l = l->next) {
+		if (! gtk_widget_get_mapped (GTK_WIDGET (l->data))) {
+			return;
+		}
+
+		if (gs_grab_is_grabbed_on (manager->priv->grab,
+					   gs_window_get_gdk_window (GS_WINDOW (l->data)))) {
+			grabbed = TRUE;
+		}
+	}
+
+	if (! grabbed) {
+		gs_debug ("All windows are mapped but none of them holds the grab yet");
+		return;
+	}
+
+	manager->priv->activated = TRUE;
+	g_signal_emit (manager, signals [ACTIVATED], 0);
+}
+
 static gboolean
 window_map_event_cb (GSWindow  *window,
 		     GdkEvent  *event,
@@ -758,6 +806,7 @@ window_map_event_cb (GSWindow  *window,
 	gs_debug ("Handling window map_event event");
 
 	manager_maybe_grab_window (manager, window);
+	manager_maybe_emit_activated (manager);
 
 	return FALSE;
 }
@@ -815,7 +864,7 @@ manager_show_window (GSManager *manager,
 {
 	apply_background_to_window (manager, window);
 
-	manager->priv->activate_time = time (NULL);
+	manager->priv->activate_time = gs_clock_get_boottime ();
 
 	if (manager->priv->lock_timeout >= 0) {
 		remove_lock_timer (manager);
@@ -823,9 +872,6 @@ manager_show_window (GSManager *manager,
 	}
 
 	add_unfade_idle (manager);
-
-	/* FIXME: only emit signal once */
-	g_signal_emit (manager, signals [ACTIVATED], 0);
 }
 
 static void
@@ -1281,9 +1327,13 @@ gs_manager_deactivate (GSManager *manager)
 	/* reset state */
 	manager->priv->active = FALSE;
 	manager->priv->activate_time = 0;
-	manager->priv->lock_active = FALSE;
+	if (manager->priv->lock_active) {
+		manager->priv->lock_active = FALSE;
+		g_object_notify (G_OBJECT (manager), "lock-active");
+	}
 	manager->priv->dialog_up = FALSE;
 	manager->priv->fading = FALSE;
+	manager->priv->activated = FALSE;
 
 	return TRUE;
 }
@@ -75,7 +75,8 @@ manager_activated_cb (GSManager *manager,
 		      GSMonitor *monitor)
 {
 	(void) manager;
-	(void) monitor;
+
+	gs_listener_activation_finished (monitor->priv->listener);
 }
 
 static void
@@ -87,6 +88,19 @@ manager_deactivated_cb (GSManager *manager,
 	gs_listener_set_active (monitor->priv->listener, FALSE);
 }
 
+static void
+manager_lock_active_changed_cb (GSManager  *manager,
+				GParamSpec *pspec,
+				GSMonitor  *monitor)
+{
+	(void) pspec;
+
+	gboolean lock_active;
+
+	gs_manager_get_lock_active (manager, &lock_active);
+	gs_listener_set_lock_active (monitor->priv->listener, lock_active);
+}
+
 static gboolean
 watcher_idle_cb (GSWatcher *watcher,
 		 gboolean   is_idle,
@@ -427,6 +441,7 @@ disconnect_manager_signals (GSMonitor *monitor)
 {
 	g_signal_handlers_disconnect_by_func (monitor->priv->manager, manager_activated_cb, monitor);
 	g_signal_handlers_disconnect_by_func (monitor->priv->manager, manager_deactivated_cb, monitor);
+	g_signal_handlers_disconnect_by_func (monitor->priv->manager, manager_lock_active_changed_cb, monitor);
 }
 
 static void
@@ -436,6 +451,8 @@ connect_manager_signals (GSMonitor *monitor)
 			  G_CALLBACK (manager_activated_cb), monitor);
 	g_signal_connect (monitor->priv->manager, "deactivated",
 			  G_CALLBACK (manager_deactivated_cb), monitor);
+	g_signal_connect (monitor->priv->manager, "notify::lock-active",
+			  G_CALLBACK (manager_lock_active_changed_cb), monitor);
 }
 
 static void
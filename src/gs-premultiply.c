@@ -0,0 +1,133 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gs-premultiply.h"
+
+/* unpremultiply_table[a] is 255 / a in 16.16 fixed point, rounded up.
+ * (c * unpremultiply_table[a]) >> 16 gives exactly the same result as
+ * c * 255 / a for every c and a in 0..255, including the out of range
+ * c > a values that show up in slightly broken premultiplied data, so
+ * the lookup can replace the divide without changing a single pixel.
+ * The largest product, 255 * 0xff0000, still fits in 32 bits.
+ */
+static const guint32 unpremultiply_table[256] = {
+	0x000000, 0xff0000, 0x7f8000, 0x550000, 0x3fc000, 0x330000,
+	0x2a8000, 0x246db7, 0x1fe000, 0x1c5556, 0x198000, 0x172e8c,
+	0x154000, 0x139d8a, 0x1236dc, 0x110000, 0x0ff000, 0x0f0000,
+	0x0e2aab, 0x0d6bcb, 0x0cc000, 0x0c2493, 0x0b9746, 0x0b1643,
+	0x0aa000, 0x0a3334, 0x09cec5, 0x0971c8, 0x091b6e, 0x08cb09,
+	0x088000, 0x0839cf, 0x07f800, 0x07ba2f, 0x078000, 0x074925,
+	0x071556, 0x06e454, 0x06b5e6, 0x0689d9, 0x066000, 0x063832,
+	0x06124a, 0x05ee24, 0x05cba3, 0x05aaab, 0x058b22, 0x056cf0,
+	0x055000, 0x05343f, 0x05199a, 0x050000, 0x04e763, 0x04cfb3,
+	0x04b8e4, 0x04a2e9, 0x048db7, 0x047944, 0x046585, 0x045271,
+	0x044000, 0x042e2a, 0x041ce8, 0x040c31, 0x03fc00, 0x03ec4f,
+	0x03dd18, 0x03ce55, 0x03c000, 0x03b217, 0x03a493, 0x039770,
+	0x038aab, 0x037e40, 0x03722a, 0x036667, 0x035af3, 0x034fcb,
+	0x0344ed, 0x033a55, 0x033000, 0x0325ee, 0x031c19, 0x031282,
+	0x030925, 0x030000, 0x02f712, 0x02ee59, 0x02e5d2, 0x02dd7c,
+	0x02d556, 0x02cd5d, 0x02c591, 0x02bdf0, 0x02b678, 0x02af29,
+	0x02a800, 0x02a0fe, 0x029a20, 0x029365, 0x028ccd, 0x028657,
+	0x028000, 0x0279ca, 0x0273b2, 0x026db7, 0x0267da, 0x026218,
+	0x025c72, 0x0256e7, 0x025175, 0x024c1c, 0x0246dc, 0x0241b3,
+	0x023ca2, 0x0237a7, 0x0232c3, 0x022df3, 0x022939, 0x022493,
+	0x022000, 0x021b82, 0x021715, 0x0212bc, 0x020e74, 0x020a3e,
+	0x020619, 0x020205, 0x01fe00, 0x01fa0c, 0x01f628, 0x01f253,
+	0x01ee8c, 0x01ead4, 0x01e72b, 0x01e38f, 0x01e000, 0x01dc80,
+	0x01d90c, 0x01d5a4, 0x01d24a, 0x01cefb, 0x01cbb8, 0x01c881,
+	0x01c556, 0x01c235, 0x01bf20, 0x01bc15, 0x01b915, 0x01b61f,
+	0x01b334, 0x01b052, 0x01ad7a, 0x01aaab, 0x01a7e6, 0x01a52a,
+	0x01a277, 0x019fcc, 0x019d2b, 0x019a91, 0x019800, 0x019578,
+	0x0192f7, 0x01907e, 0x018e0d, 0x018ba3, 0x018941, 0x0186e6,
+	0x018493, 0x018246, 0x018000, 0x017dc2, 0x017b89, 0x017958,
+	0x01772d, 0x017508, 0x0172e9, 0x0170d1, 0x016ebe, 0x016cb2,
+	0x016aab, 0x0168aa, 0x0166af, 0x0164b9, 0x0162c9, 0x0160de,
+	0x015ef8, 0x015d18, 0x015b3c, 0x015966, 0x015795, 0x0155c8,
+	0x015400, 0x01523e, 0x01507f, 0x014ec5, 0x014d10, 0x014b5f,
+	0x0149b3, 0x01480b, 0x014667, 0x0144c7, 0x01432c, 0x014194,
+	0x014000, 0x013e71, 0x013ce5, 0x013b5d, 0x0139d9, 0x013859,
+	0x0136dc, 0x013563, 0x0133ed, 0x01327b, 0x01310c, 0x012fa1,
+	0x012e39, 0x012cd5, 0x012b74, 0x012a16, 0x0128bb, 0x012763,
+	0x01260e, 0x0124bd, 0x01236e, 0x012223, 0x0120da, 0x011f94,
+	0x011e51, 0x011d11, 0x011bd4, 0x011a99, 0x011962, 0x01182c,
+	0x0116fa, 0x0115ca, 0x01149d, 0x011372, 0x01124a, 0x011124,
+	0x011000, 0x010ee0, 0x010dc1, 0x010ca5, 0x010b8b, 0x010a73,
+	0x01095e, 0x01084b, 0x01073a, 0x01062c, 0x01051f, 0x010415,
+	0x01030d, 0x010207, 0x010103, 0x010000,
+};
+
+/**
+ * gs_unpremultiply_argb32:
+ * @dst: destination for GdkPixbuf style RGBA pixels
+ * @dst_stride: rowstride of @dst
+ * @src: CAIRO_FORMAT_ARGB32 pixels, or %NULL to convert @dst in place
+ * @src_stride: rowstride of @src
+ * @width: image width
+ * @height: image height
+ *
+ * Converts premultiplied native endian ARGB pixels as cairo stores them
+ * into the non-premultiplied RGBA byte order used by GdkPixbuf.
+ **/
+void
+gs_unpremultiply_argb32 (guint8       *dst,
+			 int           dst_stride,
+			 const guint8 *src,
+			 int           src_stride,
+			 int           width,
+			 int           height)
+{
+	int i, j;
+
+	g_return_if_fail (dst != NULL);
+
+	if (src == NULL) {
+		src = dst;
+		src_stride = dst_stride;
+	}
+
+	for (i = 0; i < height; i++) {
+		const guint8 *s = src + i * src_stride;
+		guint8       *d = dst + i * dst_stride;
+
+		for (j = 0; j < width; j++) {
+			guint32 pixel;
+			guint32 r;
+
+			/* cairo pixels are always 32 bit aligned, reading
+			 * them as words takes care of the byte order */
+			memcpy (&pixel, s, sizeof (pixel));
+			r = unpremultiply_table[pixel >> 24];
+
+			d[0] = (((pixel >> 16) & 0xff) * r) >> 16;
+			d[1] = (((pixel >> 8) & 0xff) * r) >> 16;
+			d[2] = ((pixel & 0xff) * r) >> 16;
+			d[3] = pixel >> 24;
+
+			s += 4;
+			d += 4;
+		}
+	}
+}
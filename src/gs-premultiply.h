@@ -0,0 +1,36 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_PREMULTIPLY_H
+#define __GS_PREMULTIPLY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* For turning cairo image surfaces into pixbufs.  The face is drawn
+ * straight into a surface these days, so nothing in the daemon or the
+ * dialog needs it at the moment; tests/test-premultiply.c holds it to
+ * the plain divide. */
+void gs_unpremultiply_argb32(guint8* dst, int dst_stride, const guint8* src, int src_stride, int width, int height);
+
+G_END_DECLS
+
+#endif /* __GS_PREMULTIPLY_H */
@@ -0,0 +1,281 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+
+#include "gs-secure-buffer.h"
+#include "gs-debug.h"
+
+/* A small buffer for password text.  It lives in its own locked mapping
+ * so it is never written to swap or included in a core dump, and it is
+ * wiped before it is released.  The mapping has an inaccessible page on
+ * either side and the buffer sits at the very end of the usable part,
+ * so running off the end of it faults instead of reading or writing
+ * whatever happens to be next.
+ */
+struct _GSSecureBuffer
+{
+	gpointer mapping;
+	gsize    mapping_size;
+	gsize    length;
+	char     data[];
+};
+
+void
+gs_secure_zero (gpointer data,
+		gsize    len)
+{
+#ifdef HAVE_EXPLICIT_BZERO
+	explicit_bzero (data, len);
+#else
+	volatile char *p = data;
+
+	while (len-- > 0) {
+		*p++ = 0;
+	}
+#endif
+}
+
+GSSecureBuffer *
+gs_secure_buffer_new (void)
+{
+	GSSecureBuffer *buffer;
+	char           *mapping;
+	gsize           page_size;
+	gsize           needed;
+	gsize           size;
+
+	page_size = sysconf (_SC_PAGESIZE);
+	needed = sizeof (GSSecureBuffer) + GS_SECURE_BUFFER_MAX_LEN + 1;
+	needed = (needed + sizeof (gpointer) - 1) / sizeof (gpointer) * sizeof (gpointer);
+	size = (needed + page_size - 1) / page_size * page_size;
+
+	mapping = mmap (NULL, size + 2 * page_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		g_error ("Unable to allocate secure buffer: %s", g_strerror (errno));
+	}
+
+	if (mprotect (mapping + page_size, size, PROT_READ | PROT_WRITE) != 0) {
+		g_error ("Unable to allocate secure buffer: %s", g_strerror (errno));
+	}
+
+	if (mlock (mapping + page_size, size) != 0) {
+		gs_debug ("Unable to lock secure buffer: %s", g_strerror (errno));
+	}
+
+#ifdef MADV_DONTDUMP
+	madvise (mapping + page_size, size, MADV_DONTDUMP);
+#endif
+
+	buffer = (GSSecureBuffer *) (mapping + page_size + size - needed);
+	buffer->mapping = mapping;
+	buffer->mapping_size = size + 2 * page_size;
+	buffer->length = 0;
+
+	return buffer;
+}
+
+void
+gs_secure_buffer_free (GSSecureBuffer *buffer)
+{
+	char  *mapping;
+	gsize  page_size;
+	gsize  size;
+
+	if (buffer == NULL) {
+		return;
+	}
+
+	mapping = buffer->mapping;
+	page_size = sysconf (_SC_PAGESIZE);
+	size = buffer->mapping_size - 2 * page_size;
+
+	gs_secure_zero (mapping + page_size, size);
+	munlock (mapping + page_size, size);
+	munmap (mapping, size + 2 * page_size);
+}
+
+gboolean
+gs_secure_buffer_append (GSSecureBuffer *buffer,
+			 const char     *data,
+			 gssize          len)
+{
+	g_return_val_if_fail (buffer != NULL, FALSE);
+	g_return_val_if_fail (data != NULL, FALSE);
+
+	if (len < 0) {
+		len = strlen (data);
+	}
+
+	if ((gsize) len > GS_SECURE_BUFFER_MAX_LEN - buffer->length) {
+		return FALSE;
+	}
+
+	memcpy (buffer->data + buffer->length, data, len);
+	buffer->length += len;
+	buffer->data[buffer->length] = '\0';
+
+	return TRUE;
+}
+
+/* inserts len bytes of data at byte offset pos, which is clamped to
+ * the end of what is there */
+gboolean
+gs_secure_buffer_insert (GSSecureBuffer *buffer,
+			 gsize           pos,
+			 const char     *data,
+			 gssize          len)
+{
+	g_return_val_if_fail (buffer != NULL, FALSE);
+	g_return_val_if_fail (data != NULL, FALSE);
+
+	if (len < 0) {
+		len = strlen (data);
+	}
+
+	if ((gsize) len > GS_SECURE_BUFFER_MAX_LEN - buffer->length) {
+		return FALSE;
+	}
+
+	pos = MIN (pos, buffer->length);
+
+	memmove (buffer->data + pos + len,
+		 buffer->data + pos,
+		 buffer->length - pos);
+	memcpy (buffer->data + pos, data, len);
+	buffer->length += len;
+	buffer->data[buffer->length] = '\0';
+
+	return TRUE;
+}
+
+/* removes len bytes starting at byte offset pos */
+void
+gs_secure_buffer_erase (GSSecureBuffer *buffer,
+			gsize           pos,
+			gsize           len)
+{
+	gsize length;
+
+	g_return_if_fail (buffer != NULL);
+
+	if (pos >= buffer->length) {
+		return;
+	}
+
+	len = MIN (len, buffer->length - pos);
+	length = buffer->length;
+
+	memmove (buffer->data + pos,
+		 buffer->data + pos + len,
+		 length - pos - len);
+	buffer->length = length - len;
+
+	/* what moved down is still in the tail */
+	gs_secure_zero (buffer->data + buffer->length, len);
+}
+
+/* reads straight into the buffer so the text never passes through
+ * an ordinary one, returns what read() returned */
+gssize
+gs_secure_buffer_read (GSSecureBuffer *buffer,
+		       int             fd)
+{
+	gssize n;
+
+	g_return_val_if_fail (buffer != NULL, -1);
+
+	do {
+		n = read (fd,
+			  buffer->data + buffer->length,
+			  GS_SECURE_BUFFER_MAX_LEN - buffer->length);
+	} while (n < 0 && errno == EINTR);
+
+	if (n > 0) {
+		buffer->length += n;
+		buffer->data[buffer->length] = '\0';
+	}
+
+	return n;
+}
+
+void
+gs_secure_buffer_truncate (GSSecureBuffer *buffer,
+			   gsize           len)
+{
+	g_return_if_fail (buffer != NULL);
+
+	if (len >= buffer->length) {
+		return;
+	}
+
+	gs_secure_zero (buffer->data + len, buffer->length - len);
+	buffer->length = len;
+}
+
+/* removes the last UTF-8 character */
+void
+gs_secure_buffer_backspace (GSSecureBuffer *buffer)
+{
+	gsize len;
+
+	g_return_if_fail (buffer != NULL);
+
+	len = buffer->length;
+	while (len > 0) {
+		len--;
+		if ((buffer->data[len] & 0xc0) != 0x80) {
+			break;
+		}
+	}
+
+	gs_secure_buffer_truncate (buffer, len);
+}
+
+void
+gs_secure_buffer_clear (GSSecureBuffer *buffer)
+{
+	g_return_if_fail (buffer != NULL);
+
+	gs_secure_buffer_truncate (buffer, 0);
+}
+
+const char *
+gs_secure_buffer_get_data (GSSecureBuffer *buffer)
+{
+	g_return_val_if_fail (buffer != NULL, NULL);
+
+	return buffer->data;
+}
+
+gsize
+gs_secure_buffer_get_length (GSSecureBuffer *buffer)
+{
+	g_return_val_if_fail (buffer != NULL, 0);
+
+	return buffer->length;
+}
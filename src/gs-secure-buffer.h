@@ -0,0 +1,51 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_SECURE_BUFFER_H
+#define __GS_SECURE_BUFFER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* same as PAM_MAX_RESP_SIZE, nothing longer can be used as a password */
+#define GS_SECURE_BUFFER_MAX_LEN 512
+
+typedef struct _GSSecureBuffer GSSecureBuffer;
+
+GSSecureBuffer* gs_secure_buffer_new(void);
+void gs_secure_buffer_free(GSSecureBuffer* buffer);
+
+gboolean gs_secure_buffer_append(GSSecureBuffer* buffer, const char* data, gssize len);
+gboolean gs_secure_buffer_insert(GSSecureBuffer* buffer, gsize pos, const char* data, gssize len);
+void gs_secure_buffer_erase(GSSecureBuffer* buffer, gsize pos, gsize len);
+gssize gs_secure_buffer_read(GSSecureBuffer* buffer, int fd);
+void gs_secure_buffer_backspace(GSSecureBuffer* buffer);
+void gs_secure_buffer_truncate(GSSecureBuffer* buffer, gsize len);
+void gs_secure_buffer_clear(GSSecureBuffer* buffer);
+
+const char* gs_secure_buffer_get_data(GSSecureBuffer* buffer);
+gsize gs_secure_buffer_get_length(GSSecureBuffer* buffer);
+
+void gs_secure_zero(gpointer data, gsize len);
+
+G_END_DECLS
+
+#endif /* __GS_SECURE_BUFFER_H */
@@ -0,0 +1,152 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "gs-secure-entry-buffer.h"
+
+/* A GtkEntryBuffer that keeps its text in a GSSecureBuffer instead of
+ * on the heap, for the password entry.  The default buffer reallocates
+ * as the text grows and leaves the old copies behind in freed memory;
+ * this one is allocated once, locked, and wiped on every deletion.
+ */
+
+G_DEFINE_TYPE (GSSecureEntryBuffer, gs_secure_entry_buffer, GTK_TYPE_ENTRY_BUFFER)
+
+static const char *
+gs_secure_entry_buffer_get_text (GtkEntryBuffer *buffer,
+				 gsize          *n_bytes)
+{
+	GSSecureEntryBuffer *self = GS_SECURE_ENTRY_BUFFER (buffer);
+
+	if (n_bytes != NULL) {
+		*n_bytes = gs_secure_buffer_get_length (self->text);
+	}
+
+	return gs_secure_buffer_get_data (self->text);
+}
+
+static guint
+gs_secure_entry_buffer_get_length (GtkEntryBuffer *buffer)
+{
+	return GS_SECURE_ENTRY_BUFFER (buffer)->n_chars;
+}
+
+static guint
+gs_secure_entry_buffer_insert_text (GtkEntryBuffer *buffer,
+				    guint           position,
+				    const char     *chars,
+				    guint           n_chars)
+{
+	GSSecureEntryBuffer *self = GS_SECURE_ENTRY_BUFFER (buffer);
+	const char          *text;
+	gsize                offset;
+	gsize                n_bytes;
+
+	text = gs_secure_buffer_get_data (self->text);
+	position = MIN (position, self->n_chars);
+	offset = g_utf8_offset_to_pointer (text, position) - text;
+	n_bytes = g_utf8_offset_to_pointer (chars, n_chars) - chars;
+
+	/* anything longer couldn't be used as a password anyway */
+	if (! gs_secure_buffer_insert (self->text, offset, chars, n_bytes)) {
+		return 0;
+	}
+
+	self->n_chars += n_chars;
+	gtk_entry_buffer_emit_inserted_text (buffer, position, chars, n_chars);
+
+	return n_chars;
+}
+
+static guint
+gs_secure_entry_buffer_delete_text (GtkEntryBuffer *buffer,
+				    guint           position,
+				    guint           n_chars)
+{
+	GSSecureEntryBuffer *self = GS_SECURE_ENTRY_BUFFER (buffer);
+	const char          *text;
+	const char          *start;
+	const char          *end;
+
+	if (position > self->n_chars) {
+		position = self->n_chars;
+	}
+	if (position + n_chars > self->n_chars) {
+		n_chars = self->n_chars - position;
+	}
+
+	if (n_chars == 0) {
+		return 0;
+	}
+
+	text = gs_secure_buffer_get_data (self->text);
+	start = g_utf8_offset_to_pointer (text, position);
+	end = g_utf8_offset_to_pointer (start, n_chars);
+
+	gs_secure_buffer_erase (self->text, start - text, end - start);
+	self->n_chars -= n_chars;
+
+	gtk_entry_buffer_emit_deleted_text (buffer, position, n_chars);
+
+	return n_chars;
+}
+
+static void
+gs_secure_entry_buffer_finalize (GObject *object)
+{
+	GSSecureEntryBuffer *self = GS_SECURE_ENTRY_BUFFER (object);
+
+	gs_secure_buffer_free (self->text);
+	self->text = NULL;
+
+	G_OBJECT_CLASS (gs_secure_entry_buffer_parent_class)->finalize (object);
+}
+
+static void
+gs_secure_entry_buffer_class_init (GSSecureEntryBufferClass *klass)
+{
+	GObjectClass        *object_class = G_OBJECT_CLASS (klass);
+	GtkEntryBufferClass *buffer_class = GTK_ENTRY_BUFFER_CLASS (klass);
+
+	object_class->finalize = gs_secure_entry_buffer_finalize;
+
+	buffer_class->get_text = gs_secure_entry_buffer_get_text;
+	buffer_class->get_length = gs_secure_entry_buffer_get_length;
+	buffer_class->insert_text = gs_secure_entry_buffer_insert_text;
+	buffer_class->delete_text = gs_secure_entry_buffer_delete_text;
+}
+
+static void
+gs_secure_entry_buffer_init (GSSecureEntryBuffer *self)
+{
+	self->text = gs_secure_buffer_new ();
+	self->n_chars = 0;
+}
+
+GtkEntryBuffer *
+gs_secure_entry_buffer_new (void)
+{
+	return g_object_new (GS_TYPE_SECURE_ENTRY_BUFFER, NULL);
+}
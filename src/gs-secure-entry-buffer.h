@@ -0,0 +1,53 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_SECURE_ENTRY_BUFFER_H
+#define __GS_SECURE_ENTRY_BUFFER_H
+
+#include <gtk/gtk.h>
+
+#include "gs-secure-buffer.h"
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_SECURE_ENTRY_BUFFER (gs_secure_entry_buffer_get_type())
+#define GS_SECURE_ENTRY_BUFFER(o) (G_TYPE_CHECK_INSTANCE_CAST((o), GS_TYPE_SECURE_ENTRY_BUFFER, GSSecureEntryBuffer))
+#define GS_SECURE_ENTRY_BUFFER_CLASS(k) (G_TYPE_CHECK_CLASS_CAST((k), GS_TYPE_SECURE_ENTRY_BUFFER, GSSecureEntryBufferClass))
+#define GS_IS_SECURE_ENTRY_BUFFER(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), GS_TYPE_SECURE_ENTRY_BUFFER))
+#define GS_IS_SECURE_ENTRY_BUFFER_CLASS(k) (G_TYPE_CHECK_CLASS_TYPE((k), GS_TYPE_SECURE_ENTRY_BUFFER))
+#define GS_SECURE_ENTRY_BUFFER_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS((o), GS_TYPE_SECURE_ENTRY_BUFFER, GSSecureEntryBufferClass))
+
+typedef struct {
+	GtkEntryBuffer parent;
+
+	GSSecureBuffer* text;
+	guint n_chars;
+} GSSecureEntryBuffer;
+
+typedef struct {
+	GtkEntryBufferClass parent_class;
+} GSSecureEntryBufferClass;
+
+GType gs_secure_entry_buffer_get_type(void);
+GtkEntryBuffer* gs_secure_entry_buffer_new(void);
+
+G_END_DECLS
+
+#endif /* __GS_SECURE_ENTRY_BUFFER_H */
@@ -0,0 +1,234 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "gs-stats.h"
+
+/* Percentiles are taken over this many of the latest samples */
+#define N_SAMPLES 64
+
+typedef struct {
+	GSStatsEntry entry;
+	gint64       samples [N_SAMPLES];
+	guint        next_sample;
+} GSStatsRecord;
+
+/* Process wide timing aggregates, keyed by a short name such as
+ * "auth-authenticate".  Only ever used from the main thread.
+ */
+static GHashTable *stats = NULL;
+
+static GSStatsRecord *
+lookup_record (const char *name)
+{
+	GSStatsRecord *record;
+
+	if (stats == NULL) {
+		stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	}
+
+	record = g_hash_table_lookup (stats, name);
+	if (record == NULL) {
+		record = g_new0 (GSStatsRecord, 1);
+		g_hash_table_insert (stats, g_strdup (name), record);
+	}
+
+	return record;
+}
+
+void
+gs_stats_add (const char *name,
+	      gint64      usec)
+{
+	GSStatsRecord *record;
+	GSStatsEntry  *entry;
+
+	g_return_if_fail (name != NULL);
+
+	if (usec < 0) {
+		return;
+	}
+
+	record = lookup_record (name);
+	entry = &record->entry;
+
+	entry->count++;
+	entry->total += usec;
+	entry->max = MAX (entry->max, usec);
+	entry->last = usec;
+
+	record->samples [record->next_sample] = usec;
+	record->next_sample = (record->next_sample + 1) % N_SAMPLES;
+}
+
+/* Plain event counters share the table; their durations stay zero */
+void
+gs_stats_count (const char *name,
+		guint       n)
+{
+	GSStatsRecord *record;
+
+	g_return_if_fail (name != NULL);
+
+	record = lookup_record (name);
+	record->entry.count += n;
+}
+
+/* Returns NULL for names nothing was recorded under yet */
+const GSStatsEntry *
+gs_stats_lookup (const char *name)
+{
+	GSStatsRecord *record;
+
+	g_return_val_if_fail (name != NULL, NULL);
+
+	if (stats == NULL) {
+		return NULL;
+	}
+
+	record = g_hash_table_lookup (stats, name);
+	if (record == NULL) {
+		return NULL;
+	}
+
+	return &record->entry;
+}
+
+static int
+compare_samples (const void *a,
+		 const void *b)
+{
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank percentile of the latest N_SAMPLES durations added
+ * under name, zero if there are none */
+gint64
+gs_stats_percentile (const char *name,
+		     guint       percent)
+{
+	GSStatsRecord *record;
+	gint64         sorted [N_SAMPLES];
+	guint          n;
+	guint          rank;
+
+	g_return_val_if_fail (name != NULL, 0);
+	g_return_val_if_fail (percent <= 100, 0);
+
+	if (stats == NULL) {
+		return 0;
+	}
+
+	record = g_hash_table_lookup (stats, name);
+	if (record == NULL) {
+		return 0;
+	}
+
+	/* counters leave the ring empty */
+	n = MIN (record->entry.count, N_SAMPLES);
+	if (n == 0 || record->entry.total == 0) {
+		return 0;
+	}
+
+	memcpy (sorted, record->samples, n * sizeof (gint64));
+	qsort (sorted, n, sizeof (gint64), compare_samples);
+
+	rank = (percent * n + 99) / 100;
+
+	return sorted [MAX (rank, 1) - 1];
+}
+
+/* Resident set size of this process in bytes, zero where the
+ * kernel doesn't tell */
+guint64
+gs_stats_get_rss (void)
+{
+	FILE          *file;
+	unsigned long  size;
+	unsigned long  resident;
+	long           page_size;
+	int            n;
+
+	file = fopen ("/proc/self/statm", "r");
+	if (file == NULL) {
+		return 0;
+	}
+
+	n = fscanf (file, "%lu %lu", &size, &resident);
+	fclose (file);
+
+	page_size = sysconf (_SC_PAGESIZE);
+	if (n != 2 || page_size <= 0) {
+		return 0;
+	}
+
+	return (guint64) resident * page_size;
+}
+
+static gint
+compare_names (gconstpointer a,
+	       gconstpointer b)
+{
+	return strcmp (*(const char **) a, *(const char **) b);
+}
+
+void
+gs_stats_foreach (GSStatsFunc func,
+		  gpointer    data)
+{
+	GPtrArray     *names;
+	GHashTableIter iter;
+	gpointer       key;
+	guint          i;
+
+	g_return_if_fail (func != NULL);
+
+	if (stats == NULL) {
+		return;
+	}
+
+	names = g_ptr_array_sized_new (g_hash_table_size (stats));
+
+	g_hash_table_iter_init (&iter, stats);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_ptr_array_add (names, key);
+	}
+
+	g_ptr_array_sort (names, compare_names);
+
+	for (i = 0; i < names->len; i++) {
+		const char *name = g_ptr_array_index (names, i);
+
+		func (name, g_hash_table_lookup (stats, name), data);
+	}
+
+	g_ptr_array_free (names, TRUE);
+}
@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GS_STATS_H
+#define __GS_STATS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* durations are in microseconds */
+typedef struct {
+	guint count;
+	gint64 total;
+	gint64 max;
+	gint64 last;
+} GSStatsEntry;
+
+typedef void (*GSStatsFunc)(const char* name, const GSStatsEntry* entry, gpointer data);
+
+void gs_stats_add(const char* name, gint64 usec);
+void gs_stats_count(const char* name, guint n);
+void gs_stats_foreach(GSStatsFunc func, gpointer data);
+const GSStatsEntry* gs_stats_lookup(const char* name);
+gint64 gs_stats_percentile(const char* name, guint percent);
+guint64 gs_stats_get_rss(void);
+
+G_END_DECLS
+
+#endif /* __GS_STATS_H */
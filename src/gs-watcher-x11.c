@@ -29,14 +29,13 @@
 
 #include <string.h>
 #include <gdk/gdkx.h>
-
-#include <dbus/dbus.h>
-#include <dbus/dbus-glib.h>
+#include <gio/gio.h>
 
 #include "gs-watcher.h"
 #include "gs-marshal.h"
 #include "gs-debug.h"
 #include "gs-bus.h"
+#include "gs-bus-watch.h"
 
 static void     gs_watcher_class_init (GSWatcherClass *klass);
 static void     gs_watcher_init       (GSWatcher      *watcher);
@@ -58,7 +57,9 @@ struct _GSWatcherPrivate
 	guint           idle_id;
 	char           *status_message;
 
-	DBusGProxy     *presence_proxy;
+	GDBusProxy     *presence_proxy;
+	GCancellable   *presence_cancellable;
+	guint           presence_watch_id;
 	guint           watchdog_timer_id;
 };
 
@@ -369,113 +370,165 @@ set_status (GSWatcher *watcher,
 }
 
 static void
-on_presence_status_changed (DBusGProxy    *presence_proxy,
-			    guint          status,
-			    GSWatcher     *watcher)
+on_presence_signal (GDBusProxy *presence_proxy,
+		    const char *sender_name,
+		    const char *signal_name,
+		    GVariant   *parameters,
+		    GSWatcher  *watcher)
 {
 	(void) presence_proxy;
+	(void) sender_name;
+
+	if (g_strcmp0 (signal_name, "StatusChanged") == 0
+	    && g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(u)"))) {
+		guint status;
+
+		g_variant_get (parameters, "(u)", &status);
+		set_status (watcher, status);
+	} else if (g_strcmp0 (signal_name, "StatusTextChanged") == 0
+		   && g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(s)"))) {
+		const char *status_text;
+
+		g_variant_get (parameters, "(&s)", &status_text);
+		set_status_text (watcher, status_text);
+	}
+}
+
+static void
+reload_presence_status (GSWatcher  *watcher,
+			GDBusProxy *proxy)
+{
+	GVariant   *value;
+	guint       status;
+	const char *status_text;
+
+	value = g_dbus_proxy_get_cached_property (proxy, "status");
+	if (value != NULL) {
+		status = g_variant_get_uint32 (value);
+		g_variant_unref (value);
+	} else {
+		g_warning ("Couldn't get presence status");
+		return;
+	}
 
 	set_status (watcher, status);
+
+	value = g_dbus_proxy_get_cached_property (proxy, "status-text");
+	if (value != NULL) {
+		status_text = g_variant_get_string (value, NULL);
+		set_status_text (watcher, status_text);
+		g_variant_unref (value);
+	} else {
+		g_warning ("Couldn't get presence status text");
+		set_status_text (watcher, NULL);
+	}
 }
 
+/* the proxy has loaded the properties of the new owner by now */
 static void
-on_presence_status_text_changed (DBusGProxy    *presence_proxy,
-				 const char    *status_text,
-				 GSWatcher     *watcher)
+on_presence_name_owner_changed (GDBusProxy *proxy,
+				GParamSpec *pspec,
+				GSWatcher  *watcher)
 {
-	(void) presence_proxy;
+	char *owner;
+
+	(void) pspec;
 
-	set_status_text (watcher, status_text);
+	owner = g_dbus_proxy_get_name_owner (proxy);
+	if (owner != NULL) {
+		gs_debug ("GSWatcher: session manager is now %s", owner);
+		reload_presence_status (watcher, proxy);
+		g_free (owner);
+	}
 }
 
 static void
-connect_presence_watcher (GSWatcher *watcher)
+on_presence_proxy_ready (GObject      *source,
+			 GAsyncResult *result,
+			 gpointer      user_data)
 {
-	DBusGConnection *bus;
-	GError          *error;
-	DBusGProxy      *proxy;
-	guint            status;
-	const char      *status_text;
-	GValue           value = { 0, };
+	GSWatcher  *watcher;
+	GDBusProxy *proxy;
+	GError     *error;
+	char       *owner;
+
+	(void) source;
 
 	error = NULL;
-	bus = dbus_g_bus_get (DBUS_BUS_SESSION, &error);
-	if (bus == NULL) {
-		g_warning ("Unable to get session bus: %s", error->message);
+	proxy = g_dbus_proxy_new_finish (result, &error);
+	if (proxy == NULL) {
+		if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_warning ("Unable to watch session presence: %s", error->message);
+		}
 		g_error_free (error);
 		return;
 	}
 
-	watcher->priv->presence_proxy = dbus_g_proxy_new_for_name (bus,
-								   GSM_SERVICE,
-								   GSM_PRESENCE_PATH,
-								   GSM_PRESENCE_INTERFACE);
-
-	dbus_g_proxy_add_signal (watcher->priv->presence_proxy,
-				 "StatusChanged",
-				 G_TYPE_UINT,
-				 G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (watcher->priv->presence_proxy,
-				     "StatusChanged",
-				     G_CALLBACK (on_presence_status_changed),
-				     watcher,
-				     NULL);
-	dbus_g_proxy_add_signal (watcher->priv->presence_proxy,
-				 "StatusTextChanged",
-				 G_TYPE_STRING,
-				 G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (watcher->priv->presence_proxy,
-				     "StatusTextChanged",
-				     G_CALLBACK (on_presence_status_text_changed),
-				     watcher,
-				     NULL);
-
-	proxy = dbus_g_proxy_new_from_proxy (watcher->priv->presence_proxy,
-					     "org.freedesktop.DBus.Properties",
-					     GSM_PRESENCE_PATH);
-
-	status = 0;
-	status_text = NULL;
+	watcher = GS_WATCHER (user_data);
+	watcher->priv->presence_proxy = proxy;
 
-	error = NULL;
-	dbus_g_proxy_call (proxy,
-			   "Get",
-			   &error,
-			   G_TYPE_STRING, GSM_PRESENCE_INTERFACE,
-			   G_TYPE_STRING, "status",
-			   G_TYPE_INVALID,
-			   G_TYPE_VALUE, &value,
-			   G_TYPE_INVALID);
-
-	if (error != NULL) {
-		g_warning ("Couldn't get presence status: %s", error->message);
-		g_error_free (error);
+	g_signal_connect (proxy, "g-signal",
+			  G_CALLBACK (on_presence_signal), watcher);
+	g_signal_connect (proxy, "notify::g-name-owner",
+			  G_CALLBACK (on_presence_name_owner_changed), watcher);
+
+	/* the session manager may not be up yet, or restart later */
+	owner = g_dbus_proxy_get_name_owner (proxy);
+	if (owner == NULL) {
+		gs_debug ("GSWatcher: waiting for the session manager");
 		return;
-	} else {
-		status = g_value_get_uint (&value);
 	}
+	g_free (owner);
 
-	g_value_unset (&value);
+	reload_presence_status (watcher, proxy);
+}
 
-	error = NULL;
-	dbus_g_proxy_call (proxy,
-			   "Get",
-			   &error,
-			   G_TYPE_STRING, GSM_PRESENCE_INTERFACE,
-			   G_TYPE_STRING, "status-text",
-			   G_TYPE_INVALID,
-			   G_TYPE_VALUE, &value,
-			   G_TYPE_INVALID);
-
-	if (error != NULL) {
-		g_warning ("Couldn't get presence status text: %s", error->message);
-		g_error_free (error);
-	} else {
-		status_text = g_value_get_string (&value);
+static void
+connect_presence_watcher (GDBusConnection *connection,
+			  gpointer         user_data)
+{
+	GSWatcher *watcher = GS_WATCHER (user_data);
+
+	watcher->priv->presence_cancellable = g_cancellable_new ();
+
+	g_dbus_proxy_new (connection,
+			  G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+			  NULL,
+			  GSM_SERVICE,
+			  GSM_PRESENCE_PATH,
+			  GSM_PRESENCE_INTERFACE,
+			  watcher->priv->presence_cancellable,
+			  on_presence_proxy_ready,
+			  watcher);
+}
+
+static void
+disconnect_presence_watcher (GSWatcher *watcher)
+{
+	if (watcher->priv->presence_cancellable != NULL) {
+		g_cancellable_cancel (watcher->priv->presence_cancellable);
+		g_clear_object (&watcher->priv->presence_cancellable);
 	}
 
-	set_status (watcher, status);
-	set_status_text (watcher, status_text);
+	if (watcher->priv->presence_proxy != NULL) {
+		g_signal_handlers_disconnect_by_func (watcher->priv->presence_proxy,
+						      on_presence_signal,
+						      watcher);
+		g_signal_handlers_disconnect_by_func (watcher->priv->presence_proxy,
+						      on_presence_name_owner_changed,
+						      watcher);
+		g_clear_object (&watcher->priv->presence_proxy);
+	}
+}
+
+static void
+presence_bus_lost (GDBusConnection *connection,
+		   gpointer         user_data)
+{
+	(void) connection;
+
+	/* the bus watch sets it up again once the bus is back */
+	disconnect_presence_watcher (GS_WATCHER (user_data));
 }
 
 static void
@@ -486,7 +539,10 @@ gs_watcher_init (GSWatcher *watcher)
 	watcher->priv->enabled = TRUE;
 	watcher->priv->active = FALSE;
 
-	connect_presence_watcher (watcher);
+	watcher->priv->presence_watch_id = gs_bus_watch (G_BUS_TYPE_SESSION,
+							 connect_presence_watcher,
+							 presence_bus_lost,
+							 watcher);
 
 	/* time before idle signal to send notice signal */
 	watcher->priv->delta_notice_timeout = 10;
@@ -514,9 +570,8 @@ gs_watcher_finalize (GObject *object)
 
 	watcher->priv->active = FALSE;
 
-	if (watcher->priv->presence_proxy != NULL) {
-		g_object_unref (watcher->priv->presence_proxy);
-	}
+	gs_bus_unwatch (watcher->priv->presence_watch_id);
+	disconnect_presence_watcher (watcher);
 
 	g_free (watcher->priv->status_message);
 
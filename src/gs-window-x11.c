@@ -27,6 +27,7 @@
 #include <sys/wait.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
@@ -38,6 +39,9 @@
 #include <libgnome-desktop/gnome-wall-clock.h>
 
 #include "gs-window.h"
+#include "gs-key-queue.h"
+#include "gs-secure-buffer.h"
+#include "gs-stats.h"
 #include "gs-marshal.h"
 #include "subprocs.h"
 #include "gs-debug.h"
@@ -59,7 +63,6 @@ enum {
 	DIALOG_RESPONSE_OK
 };
 
-#define MAX_QUEUED_EVENTS 16
 #define INFO_BAR_SECONDS 30
 
 struct _GSWindowPrivate
@@ -104,14 +107,21 @@ struct _GSWindowPrivate
 
 	gint       lock_pid;
 	gint       lock_watch_id;
+	gint       lock_stdin;
 	gint       dialog_response;
 	gboolean   dialog_quit_requested;
+	gboolean   dialog_finishing;
 	gboolean   dialog_shake_in_progress;
 
 	gint       keyboard_pid;
 	gint       keyboard_watch_id;
 
-	GList     *key_events;
+	GSKeyQueue key_queue;
+	GSSecureBuffer *typeahead;
+	gboolean   typeahead_submit;
+
+	gint64     auth_started;
+	gint64     dialog_spawned;
 
 	gdouble    last_x;
 	gdouble    last_y;
@@ -863,6 +873,7 @@ static gboolean
 spawn_on_window (GSWindow *window,
 		 char     *command,
 		 int      *pid,
+		 int      *standard_input,
 		 GIOFunc   watch_func,
 		 gpointer  user_data,
 		 gint     *watch_id)
@@ -895,7 +906,7 @@ spawn_on_window (GSWindow *window,
 					   NULL,
 					   NULL,
 					   &child_pid,
-					   NULL,
+					   standard_input,
 					   &standard_output,
 					   &standard_error,
 					   &error);
@@ -950,7 +961,12 @@ static void
 lock_plug_added (GtkWidget *widget,
 		 GSWindow  *window)
 {
-	(void) window;
+	/* the dialog is up and can take a password */
+	if (window->priv->dialog_spawned > 0) {
+		gs_stats_add ("dialog-spawn",
+			      g_get_monotonic_time () - window->priv->dialog_spawned);
+		window->priv->dialog_spawned = 0;
+	}
 
 	gtk_widget_show (widget);
 }
@@ -999,31 +1015,67 @@ keyboard_socket_destroyed (GtkWidget *widget,
 static void
 forward_key_events (GSWindow *window)
 {
-	window->priv->key_events = g_list_reverse (window->priv->key_events);
-
-	while (window->priv->key_events != NULL) {
-		GdkEventKey *event = window->priv->key_events->data;
+	gs_key_queue_forward (&window->priv->key_queue, GTK_WINDOW (window));
+}
 
-		gtk_window_propagate_key_event (GTK_WINDOW (window), event);
+static void
+remove_key_events (GSWindow *window)
+{
+	gs_key_queue_clear (&window->priv->key_queue);
 
-		gdk_event_free ((GdkEvent *)event);
-		window->priv->key_events = g_list_delete_link (window->priv->key_events,
-							       window->priv->key_events);
-	}
+	gs_secure_buffer_free (window->priv->typeahead);
+	window->priv->typeahead = NULL;
+	window->priv->typeahead_submit = FALSE;
 }
 
+/* Hands everything typed before the dialog was ready to it on its
+ * stdin, with a trailing newline if it was ended with Return.  This is
+ * done once, when the dialog reports its window, and closes the pipe.
+ */
 static void
-remove_key_events (GSWindow *window)
+send_typeahead (GSWindow *window)
 {
-	window->priv->key_events = g_list_reverse (window->priv->key_events);
+	const char *data;
+	gsize       len;
+	gssize      n;
+
+	if (window->priv->lock_stdin < 0) {
+		return;
+	}
+
+	if (window->priv->typeahead != NULL) {
+		data = gs_secure_buffer_get_data (window->priv->typeahead);
+		len = gs_secure_buffer_get_length (window->priv->typeahead);
 
-	while (window->priv->key_events) {
-		GdkEventKey *event = window->priv->key_events->data;
+		/* typeahead_key_event() keeps room for this */
+		if (len > 0
+		    && window->priv->typeahead_submit
+		    && gs_secure_buffer_append (window->priv->typeahead, "\n", 1)) {
+			len++;
+		}
+
+		gs_debug ("Sending %" G_GSIZE_FORMAT " bytes of type-ahead to the dialog", len);
+
+		while (len > 0) {
+			n = write (window->priv->lock_stdin, data, len);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				gs_debug ("Unable to send type-ahead: %s", g_strerror (errno));
+				break;
+			}
+			data += n;
+			len -= n;
+		}
 
-		gdk_event_free ((GdkEvent *)event);
-		window->priv->key_events = g_list_delete_link (window->priv->key_events,
-							       window->priv->key_events);
+		gs_secure_buffer_free (window->priv->typeahead);
+		window->priv->typeahead = NULL;
+		window->priv->typeahead_submit = FALSE;
 	}
+
+	close (window->priv->lock_stdin);
+	window->priv->lock_stdin = -1;
 }
 
 static void
@@ -1200,6 +1252,7 @@ embed_keyboard (GSWindow *window)
 	res = spawn_on_window (window,
 			       window->priv->keyboard_command,
 			       &window->priv->keyboard_pid,
+			       NULL,
 			       (GIOFunc)keyboard_command_watch,
 			       window,
 			       &window->priv->keyboard_watch_id);
@@ -1237,6 +1290,19 @@ create_lock_socket (GSWindow *window,
 	}
 }
 
+static void
+reap_finishing_dialog (GPid     pid,
+		       gint     status,
+		       gpointer data)
+{
+	(void) status;
+	(void) data;
+
+	gs_debug ("Dialog exited after refreshing credentials");
+
+	g_spawn_close_pid (pid);
+}
+
 static void
 gs_window_dialog_finish (GSWindow *window)
 {
@@ -1247,6 +1313,14 @@ gs_window_dialog_finish (GSWindow *window)
 	/* make sure we finish the keyboard thing too */
 	keyboard_command_finish (window);
 
+	if (window->priv->dialog_finishing && window->priv->lock_pid > 0) {
+		/* it has answered and is only refreshing credentials,
+		 * let it get on with that and reap it when it is done */
+		g_child_watch_add (window->priv->lock_pid, reap_finishing_dialog, NULL);
+		window->priv->lock_pid = 0;
+	}
+	window->priv->dialog_finishing = FALSE;
+
 	/* send a signal just in case */
 	kill_dialog_command (window);
 
@@ -1257,6 +1331,11 @@ gs_window_dialog_finish (GSWindow *window)
 		window->priv->lock_pid = 0;
 	}
 
+	if (window->priv->lock_stdin >= 0) {
+		close (window->priv->lock_stdin);
+		window->priv->lock_stdin = -1;
+	}
+
 	/* remove events for the case were we failed to show socket */
 	remove_key_events (window);
 }
@@ -1345,12 +1424,52 @@ popdown_dialog (GSWindow *window)
 	remove_command_watches (window);
 }
 
+/* The dialog reports each attempt as TIMING=name:usec ..., where
+ * started is when it began on the (system wide) monotonic clock.
+ */
+static void
+record_auth_timing (GSWindow   *window,
+		    const char *line)
+{
+	char **fields;
+	int    i;
+
+	fields = g_strsplit (strstr (line, "TIMING=") + strlen ("TIMING="), " ", -1);
+
+	for (i = 0; fields[i] != NULL; i++) {
+		char  *value;
+		char  *name;
+		gint64 usec;
+
+		value = strchr (fields[i], ':');
+		if (value == NULL) {
+			continue;
+		}
+
+		*value++ = '\0';
+		usec = g_ascii_strtoll (value, NULL, 10);
+
+		if (strcmp (fields[i], "started") == 0) {
+			window->priv->auth_started = usec;
+			continue;
+		}
+
+		name = g_strdup_printf ("auth-%s", fields[i]);
+		g_strdelimit (name, "_", '-');
+		gs_stats_add (name, usec);
+		g_free (name);
+	}
+
+	g_strfreev (fields);
+}
+
 static gboolean
 lock_command_watch (GIOChannel   *source,
 		    GIOCondition  condition,
 		    GSWindow     *window)
 {
 	gboolean finished = FALSE;
+	gint64   start;
 
 	g_return_val_if_fail (GS_IS_WINDOW (window), FALSE);
 
@@ -1370,16 +1489,26 @@ lock_command_watch (GIOChannel   *source,
 				guint32 id;
 				char    c;
 				if (1 == sscanf (line, " WINDOW ID= %" G_GUINT32_FORMAT " %c", &id, &c)) {
+					send_typeahead (window);
 					create_lock_socket (window, id);
 				}
+			} else if (strstr (line, "TIMING=") != NULL) {
+				record_auth_timing (window, line);
 			} else if (strstr (line, "NOTICE=") != NULL) {
 				if (strstr (line, "NOTICE=AUTH FAILED") != NULL) {
 					shake_dialog (window);
+				} else if (strstr (line, "NOTICE=SETCRED PENDING") != NULL) {
+					window->priv->dialog_finishing = TRUE;
 				}
 			} else if (strstr (line, "RESPONSE=") != NULL) {
 				if (strstr (line, "RESPONSE=OK") != NULL) {
 					gs_debug ("Got OK response");
 					window->priv->dialog_response = DIALOG_RESPONSE_OK;
+
+					if (window->priv->auth_started > 0) {
+						gs_stats_add ("unlock-response",
+							      g_get_monotonic_time () - window->priv->auth_started);
+					}
 				} else {
 					gs_debug ("Got CANCEL response");
 					window->priv->dialog_response = DIALOG_RESPONSE_CANCEL;
@@ -1410,12 +1539,16 @@ lock_command_watch (GIOChannel   *source,
 	}
 
 	if (finished) {
+		start = g_get_monotonic_time ();
 		popdown_dialog (window);
 
 		if (window->priv->dialog_response == DIALOG_RESPONSE_OK) {
+			gs_stats_add ("unlock-popdown", g_get_monotonic_time () - start);
 			add_emit_deactivated_idle (window);
 		}
 
+		window->priv->auth_started = 0;
+
 		window->priv->lock_watch_id = 0;
 
 		return FALSE;
@@ -1494,15 +1627,18 @@ popup_dialog (GSWindow *window)
 
 	window->priv->dialog_quit_requested = FALSE;
 	window->priv->dialog_shake_in_progress = FALSE;
+	window->priv->dialog_spawned = g_get_monotonic_time ();
 
 	result = spawn_on_window (window,
 				  command->str,
 				  &window->priv->lock_pid,
+				  &window->priv->lock_stdin,
 				  (GIOFunc)lock_command_watch,
 				  window,
 				  &window->priv->lock_watch_id);
 	if (! result) {
 		gs_debug ("Could not start command: %s", command->str);
+		window->priv->dialog_spawned = 0;
 	}
 
 	g_string_free (command, TRUE);
@@ -1790,7 +1926,7 @@ queue_key_event (GSWindow    *window,
 		 GdkEventKey *event)
 {
 	/* Eat the first return, enter, escape, or space */
-	if (window->priv->key_events == NULL
+	if (gs_key_queue_get_length (&window->priv->key_queue) == 0
 	    && (event->keyval == GDK_KEY_Return
 		|| event->keyval == GDK_KEY_KP_Enter
 		|| event->keyval == GDK_KEY_Escape
@@ -1798,18 +1934,87 @@ queue_key_event (GSWindow    *window,
 		return;
 	}
 
-	/* Only cache MAX_QUEUED_EVENTS key events.  If there are any more than this then
-	   something is wrong */
 	/* Don't queue keys that may cause focus navigation in the dialog */
-	if (g_list_length (window->priv->key_events) < MAX_QUEUED_EVENTS
-	    && event->keyval != GDK_KEY_Tab
+	if (event->keyval != GDK_KEY_Tab
 	    && event->keyval != GDK_KEY_Up
 	    && event->keyval != GDK_KEY_Down) {
-		window->priv->key_events = g_list_prepend (window->priv->key_events,
-							   gdk_event_copy ((GdkEvent *)event));
+		if (! gs_key_queue_push (&window->priv->key_queue, event)) {
+			gs_debug ("Key queue is full, dropping key press");
+		}
 	}
 }
 
+/* Until the dialog has reported its window, text is collected in the
+ * type-ahead buffer instead of being queued as key presses, so that
+ * however long the dialog takes to start nothing typed is lost.
+ * Returns TRUE if the key was taken care of.
+ */
+static gboolean
+typeahead_key_event (GSWindow    *window,
+		     GdkEventKey *event)
+{
+	gunichar c;
+	char     buf[6];
+	int      len;
+
+	if (! window->priv->lock_enabled || window->priv->lock_socket != NULL) {
+		return FALSE;
+	}
+
+	switch (event->keyval) {
+	case GDK_KEY_Return:
+	case GDK_KEY_KP_Enter:
+		if (window->priv->typeahead != NULL
+		    && gs_secure_buffer_get_length (window->priv->typeahead) > 0) {
+			window->priv->typeahead_submit = TRUE;
+		}
+		return TRUE;
+	case GDK_KEY_Escape:
+		if (window->priv->typeahead != NULL) {
+			gs_secure_buffer_clear (window->priv->typeahead);
+		}
+		window->priv->typeahead_submit = FALSE;
+		return TRUE;
+	case GDK_KEY_BackSpace:
+		if (window->priv->typeahead != NULL && ! window->priv->typeahead_submit) {
+			gs_secure_buffer_backspace (window->priv->typeahead);
+		}
+		return TRUE;
+	default:
+		break;
+	}
+
+	/* anything that is not plain text is dropped */
+	if (window->priv->typeahead_submit
+	    || (event->state & (GDK_CONTROL_MASK | GDK_MOD1_MASK)) != 0) {
+		return TRUE;
+	}
+
+	c = gdk_keyval_to_unicode (event->keyval);
+	if (c == 0 || g_unichar_iscntrl (c)) {
+		return TRUE;
+	}
+
+	if (window->priv->typeahead == NULL) {
+		/* Eat the space that is often used to wake up the screen */
+		if (c == ' ') {
+			return TRUE;
+		}
+
+		window->priv->typeahead = gs_secure_buffer_new ();
+	}
+
+	/* one byte is kept free for the newline a Return adds */
+	len = g_unichar_to_utf8 (c, buf);
+	if (gs_secure_buffer_get_length (window->priv->typeahead) + len >= GS_SECURE_BUFFER_MAX_LEN
+	    || ! gs_secure_buffer_append (window->priv->typeahead, buf, len)) {
+		gs_debug ("Type-ahead buffer is full, dropping key press");
+	}
+	gs_secure_zero (buf, sizeof (buf));
+
+	return TRUE;
+}
+
 static gboolean
 maybe_handle_activity (GSWindow *window)
 {
@@ -1840,7 +2045,9 @@ gs_window_real_key_press_event (GtkWidget   *widget,
 
 	maybe_handle_activity (GS_WINDOW (widget));
 
-	queue_key_event (GS_WINDOW (widget), event);
+	if (! typeahead_key_event (GS_WINDOW (widget), event)) {
+		queue_key_event (GS_WINDOW (widget), event);
+	}
 
 	if (GTK_WIDGET_CLASS (gs_window_parent_class)->key_press_event) {
 		GTK_WIDGET_CLASS (gs_window_parent_class)->key_press_event (widget, event);
@@ -2307,6 +2514,8 @@ gs_window_init (GSWindow *window)
 	window->priv->last_x = -1;
 	window->priv->last_y = -1;
 
+	window->priv->lock_stdin = -1;
+
 	gtk_window_set_decorated (GTK_WINDOW (window), FALSE);
 
 	gtk_window_set_skip_taskbar_hint (GTK_WINDOW (window), TRUE);
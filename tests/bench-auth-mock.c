@@ -0,0 +1,127 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "gs-auth.h"
+#include "gs-auth-backend.h"
+
+/* Times unlock attempts against the mock backend, which leaves only
+ * our own side of an attempt: the dispatch, the conversation and the
+ * secure buffers.  GS_AUTH_MOCK_* from the environment are honoured,
+ * so a stack that takes its time can be played too.
+ */
+
+#define DEFAULT_ITERATIONS 10000
+
+static gboolean
+answer_cb (GSAuthMessageStyle style,
+	   const char        *msg,
+	   GSSecureBuffer    *response,
+	   GCancellable      *cancellable,
+	   gpointer           data)
+{
+	(void) msg;
+	(void) cancellable;
+	(void) data;
+
+	if (style != GS_AUTH_MESSAGE_PROMPT_ECHO_ON
+	    && style != GS_AUTH_MESSAGE_PROMPT_ECHO_OFF) {
+		return TRUE;
+	}
+
+	return gs_secure_buffer_append (response, g_getenv ("GS_AUTH_MOCK_PASSWORD"), -1);
+}
+
+static int
+compare_gint64 (gconstpointer a,
+		gconstpointer b)
+{
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	GSAuthTimeline timeline;
+	gint64        *samples;
+	gint64         total;
+	gint64         conversation;
+	guint          iterations;
+	guint          i;
+
+	iterations = argc > 1 ? strtoul (argv [1], NULL, 10) : DEFAULT_ITERATIONS;
+	if (iterations == 0) {
+		g_printerr ("usage: %s [ITERATIONS]\n", argv [0]);
+		return 1;
+	}
+
+	gs_auth_use_backend (&gs_auth_mock_backend);
+	if (! gs_auth_init ()) {
+		g_printerr ("Unable to set up the mock backend\n");
+		return 1;
+	}
+
+	g_setenv ("GS_AUTH_MOCK_PASSWORD", "password", FALSE);
+
+	samples = g_new (gint64, iterations);
+	total = 0;
+	conversation = 0;
+
+	for (i = 0; i < iterations; i++) {
+		GError *error = NULL;
+
+		if (! gs_auth_verify_user (g_get_user_name (), NULL, answer_cb, NULL, NULL, &error)) {
+			g_printerr ("Attempt %u failed: %s\n", i, error->message);
+			g_error_free (error);
+			g_free (samples);
+			return 1;
+		}
+
+		gs_auth_get_timeline (&timeline);
+		samples [i] = timeline.authenticate;
+		total += timeline.authenticate;
+		conversation += timeline.conversation;
+	}
+
+	qsort (samples, iterations, sizeof (gint64), compare_gint64);
+
+	g_print ("%u attempts\n", iterations);
+	g_print ("authenticate  mean %8.2f us  p50 %6" G_GINT64_FORMAT " us  p95 %6" G_GINT64_FORMAT " us  max %6" G_GINT64_FORMAT " us\n",
+		 (double) total / iterations,
+		 samples [iterations / 2],
+		 samples [iterations * 95 / 100],
+		 samples [iterations - 1]);
+	g_print ("conversation  mean %8.2f us\n",
+		 (double) conversation / iterations);
+
+	g_free (samples);
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Times the listener's method dispatch on its own, without a bus: the
+ * lookup listener_dbus_handle_method_call() does for every call, in the
+ * table class_init builds, against comparing the name with each method
+ * in turn as the listener used to.  The listener is built into this
+ * file so that its static table can be reached.
+ */
+
+#include "../src/gs-listener-dbus.c"
+
+#include <stdlib.h>
+
+#define DEFAULT_ITERATIONS 1000000
+
+static GSListenerMethodFunc
+sequential_lookup (const char *method_name)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (listener_methods); i++) {
+		if (strcmp (method_name, listener_methods [i].name) == 0) {
+			return listener_methods [i].func;
+		}
+	}
+
+	return NULL;
+}
+
+/* the function pointers are summed so the lookups can't be dropped */
+static double
+time_lookups (GSListenerMethodFunc (*lookup) (const char *),
+	      const char           *method_name,
+	      guint                 iterations,
+	      guintptr             *sink)
+{
+	gint64 start;
+	guint  i;
+
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < iterations; i++) {
+		*sink += (guintptr) lookup (method_name);
+	}
+
+	return (g_get_monotonic_time () - start) * 1000.0 / iterations;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	guintptr sink;
+	guint    iterations;
+	guint    i;
+
+	iterations = argc > 1 ? strtoul (argv [1], NULL, 10) : DEFAULT_ITERATIONS;
+	if (iterations == 0) {
+		g_printerr ("usage: %s [ITERATIONS]\n", argv [0]);
+		return 1;
+	}
+
+	/* builds the table */
+	g_type_class_unref (g_type_class_ref (GS_TYPE_LISTENER));
+
+	g_print ("%u lookups each\n", iterations);
+	g_print ("%-24s %10s %10s\n", "", "table", "sequential");
+
+	sink = 0;
+
+	for (i = 0; i < G_N_ELEMENTS (listener_methods); i++) {
+		char  *method_name;
+		double table;
+		double sequential;
+
+		/* a name of its own, as it arrives in a message */
+		method_name = g_strdup (listener_methods [i].name);
+
+		table = time_lookups (listener_lookup_method, method_name, iterations, &sink);
+		sequential = time_lookups (sequential_lookup, method_name, iterations, &sink);
+
+		g_print ("%-24s %7.1f ns %7.1f ns\n",
+			 method_name,
+			 table,
+			 sequential);
+
+		g_free (method_name);
+	}
+
+	return sink == 0 ? 1 : 0;
+}
@@ -0,0 +1,256 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "gs-listener-dbus.h"
+#include "gs-bus.h"
+
+/* Round trips to the listener's methods over a private bus, the way
+ * panels and power managers poll it.  The listener runs on the main
+ * loop as it does in the daemon; a client thread makes the calls.
+ */
+
+#define DEFAULT_ITERATIONS 2000
+
+typedef struct {
+	const char *interface;
+	const char *method;
+	const char *signature;
+} Call;
+
+static const Call calls [] = {
+	{ GS_INTERFACE,                      "GetActive",            NULL },
+	{ GS_INTERFACE,                      "GetState",             NULL },
+	{ GS_INTERFACE,                      "GetActiveTime",        NULL },
+	{ GS_INTERFACE,                      "SimulateUserActivity", NULL },
+	{ GS_INTERFACE,                      "GetStats",             NULL },
+	{ "org.freedesktop.DBus.Properties", "GetAll",               "(s)" },
+	{ GS_INTERFACE,                      "Inhibit",              "(ss)" },
+};
+
+typedef struct {
+	GMainLoop *loop;
+	char      *address;
+	guint      iterations;
+	gboolean   failed;
+} Bench;
+
+static GVariant *
+call_parameters (const Call *call)
+{
+	if (g_strcmp0 (call->signature, "(s)") == 0) {
+		return g_variant_new ("(s)", GS_STATS_INTERFACE);
+	}
+
+	if (g_strcmp0 (call->signature, "(ss)") == 0) {
+		return g_variant_new ("(ss)", "bench-listener", "benchmarking");
+	}
+
+	return NULL;
+}
+
+static gboolean
+wait_for_listener (GDBusConnection *connection)
+{
+	guint i;
+
+	for (i = 0; i < 500; i++) {
+		GVariant *reply;
+
+		reply = g_dbus_connection_call_sync (connection,
+						     DBUS_SERVICE,
+						     DBUS_PATH,
+						     DBUS_INTERFACE,
+						     "GetNameOwner",
+						     g_variant_new ("(s)", GS_SERVICE),
+						     NULL,
+						     G_DBUS_CALL_FLAGS_NONE,
+						     -1,
+						     NULL,
+						     NULL);
+		if (reply != NULL) {
+			g_variant_unref (reply);
+			return TRUE;
+		}
+
+		g_usleep (10000);
+	}
+
+	return FALSE;
+}
+
+static gboolean
+bench_call (GDBusConnection *connection,
+	    const Call      *call,
+	    guint            iterations)
+{
+	gint64 start;
+	gint64 elapsed;
+	guint  i;
+
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < iterations; i++) {
+		GVariant *reply;
+		GError   *error = NULL;
+
+		reply = g_dbus_connection_call_sync (connection,
+						     GS_SERVICE,
+						     GS_PATH,
+						     call->interface,
+						     call->method,
+						     call_parameters (call),
+						     NULL,
+						     G_DBUS_CALL_FLAGS_NONE,
+						     -1,
+						     NULL,
+						     &error);
+		if (reply == NULL) {
+			gboolean missing;
+
+			/* so that the same client times listeners that
+			 * predate some of the methods */
+			missing = i == 0 && g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD);
+			if (missing) {
+				g_print ("%-24s %11s\n", call->method, "not provided");
+			} else {
+				g_printerr ("%s failed: %s\n", call->method, error->message);
+			}
+
+			g_error_free (error);
+			return missing;
+		}
+
+		g_variant_unref (reply);
+	}
+
+	elapsed = g_get_monotonic_time () - start;
+
+	g_print ("%-24s %8.1f us  %8.0f calls/s\n",
+		 call->method,
+		 (double) elapsed / iterations,
+		 iterations * (double) G_USEC_PER_SEC / elapsed);
+
+	return TRUE;
+}
+
+/* from the main loop itself, so that it can't be missed by a loop
+ * that isn't running yet */
+static gboolean
+bench_done_idle (Bench *bench)
+{
+	g_main_loop_quit (bench->loop);
+
+	return FALSE;
+}
+
+static gpointer
+client_thread_func (gpointer data)
+{
+	Bench           *bench = data;
+	GDBusConnection *connection;
+	GError          *error = NULL;
+	guint            i;
+
+	connection = g_dbus_connection_new_for_address_sync (bench->address,
+							     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+							     | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+							     NULL,
+							     NULL,
+							     &error);
+	if (connection == NULL) {
+		g_printerr ("Unable to connect to the test bus: %s\n", error->message);
+		g_error_free (error);
+		bench->failed = TRUE;
+		g_idle_add ((GSourceFunc) bench_done_idle, bench);
+		return NULL;
+	}
+
+	if (! wait_for_listener (connection)) {
+		g_printerr ("The listener never took %s\n", GS_SERVICE);
+		bench->failed = TRUE;
+	}
+
+	g_print ("%u calls each\n", bench->iterations);
+
+	for (i = 0; i < G_N_ELEMENTS (calls) && ! bench->failed; i++) {
+		if (! bench_call (connection, &calls [i], bench->iterations)) {
+			bench->failed = TRUE;
+		}
+	}
+
+	g_object_unref (connection);
+	g_idle_add ((GSourceFunc) bench_done_idle, bench);
+
+	return NULL;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	GTestDBus  *bus;
+	GSListener *listener;
+	GThread    *client;
+	Bench       bench;
+	GError     *error = NULL;
+
+	bench.iterations = argc > 1 ? strtoul (argv [1], NULL, 10) : DEFAULT_ITERATIONS;
+	if (bench.iterations == 0) {
+		g_printerr ("usage: %s [ITERATIONS]\n", argv [0]);
+		return 1;
+	}
+
+	bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+	g_test_dbus_up (bus);
+
+	/* keep the listener off the real system bus as well */
+	bench.address = g_strdup (g_test_dbus_get_bus_address (bus));
+	g_setenv ("DBUS_SYSTEM_BUS_ADDRESS", bench.address, TRUE);
+
+	listener = gs_listener_new ();
+	if (! gs_listener_acquire (listener, &error)) {
+		g_printerr ("Unable to start the listener: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	bench.loop = g_main_loop_new (NULL, FALSE);
+	bench.failed = FALSE;
+
+	client = g_thread_new ("bench-client", client_thread_func, &bench);
+	g_main_loop_run (bench.loop);
+	g_thread_join (client);
+
+	g_object_unref (listener);
+	g_main_loop_unref (bench.loop);
+	g_free (bench.address);
+
+	g_test_dbus_down (bus);
+	g_object_unref (bus);
+
+	return bench.failed ? 1 : 0;
+}
@@ -0,0 +1,240 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "gs-auth.h"
+#include "gs-auth-backend.h"
+
+/* What the fake user types, and what the backend asked for.  With
+ * no answer the user sits at the prompt until it is taken away.
+ */
+typedef struct {
+	const char *answer;
+	guint       n_messages;
+	guint       n_prompts;
+	gboolean    cancelled;
+} Conversation;
+
+static gboolean
+answer_cb (GSAuthMessageStyle style,
+	   const char        *msg,
+	   GSSecureBuffer    *response,
+	   GCancellable      *cancellable,
+	   gpointer           data)
+{
+	Conversation *conversation = data;
+
+	(void) msg;
+
+	conversation->n_messages++;
+
+	if (style != GS_AUTH_MESSAGE_PROMPT_ECHO_ON
+	    && style != GS_AUTH_MESSAGE_PROMPT_ECHO_OFF) {
+		return TRUE;
+	}
+
+	conversation->n_prompts++;
+
+	if (conversation->answer == NULL) {
+		while (! g_cancellable_is_cancelled (cancellable)) {
+			g_main_context_iteration (NULL, TRUE);
+		}
+
+		conversation->cancelled = TRUE;
+		return FALSE;
+	}
+
+	return gs_secure_buffer_append (response, conversation->answer, -1);
+}
+
+static void
+mock_reset (void)
+{
+	g_setenv ("GS_AUTH_MOCK_PASSWORD", "secret", TRUE);
+	g_unsetenv ("GS_AUTH_MOCK_LATENCY");
+	g_unsetenv ("GS_AUTH_MOCK_PROMPTS");
+	g_unsetenv ("GS_AUTH_MOCK_SECONDARY_LATENCY");
+}
+
+static void
+test_backend (void)
+{
+	/* an unknown name leaves the choice alone, and the mock can't
+	 * be picked by name as it isn't in the table */
+	g_assert_false (gs_auth_set_backend ("no-such-backend"));
+	g_assert_false (gs_auth_set_backend ("mock"));
+	g_assert_cmpstr (gs_auth_get_backend (), ==, "mock");
+	g_assert_true (gs_auth_priv_init ());
+	g_assert_true (gs_auth_init ());
+}
+
+static void
+test_right_password (void)
+{
+	Conversation conversation = { "secret", 0, 0, FALSE };
+	GError      *error = NULL;
+
+	mock_reset ();
+
+	g_assert_true (gs_auth_verify_user (g_get_user_name (), NULL, answer_cb, &conversation, NULL, &error));
+	g_assert_no_error (error);
+	g_assert_cmpuint (conversation.n_prompts, ==, 1);
+}
+
+static void
+test_wrong_password (void)
+{
+	Conversation conversation = { "guess", 0, 0, FALSE };
+	GError      *error = NULL;
+
+	mock_reset ();
+
+	g_assert_false (gs_auth_verify_user (g_get_user_name (), NULL, answer_cb, &conversation, NULL, &error));
+	g_assert_error (error, GS_AUTH_ERROR, GS_AUTH_ERROR_AUTH_ERROR);
+	g_error_free (error);
+}
+
+static void
+test_prompts (void)
+{
+	Conversation   conversation = { "secret", 0, 0, FALSE };
+	GSAuthTimeline timeline;
+	GError        *error = NULL;
+
+	mock_reset ();
+	g_setenv ("GS_AUTH_MOCK_PROMPTS", "info:Hello;on:Token:;off:Password:;error:Nope", TRUE);
+
+	g_assert_true (gs_auth_verify_user (g_get_user_name (), NULL, answer_cb, &conversation, NULL, &error));
+	g_assert_no_error (error);
+	g_assert_cmpuint (conversation.n_messages, ==, 4);
+	g_assert_cmpuint (conversation.n_prompts, ==, 2);
+
+	gs_auth_get_timeline (&timeline);
+	g_assert_cmpuint (timeline.n_prompts, ==, 4);
+	g_assert_cmpint (timeline.authenticate, >=, timeline.conversation);
+}
+
+static gboolean
+cancel_cb (GCancellable *cancellable)
+{
+	g_cancellable_cancel (cancellable);
+
+	return FALSE;
+}
+
+static void
+test_cancelled (void)
+{
+	Conversation  conversation = { "secret", 0, 0, FALSE };
+	GCancellable *cancellable;
+	GError       *error = NULL;
+	gint64        start;
+
+	mock_reset ();
+	g_setenv ("GS_AUTH_MOCK_LATENCY", "10000", TRUE);
+
+	cancellable = g_cancellable_new ();
+	g_timeout_add (10, (GSourceFunc) cancel_cb, cancellable);
+
+	/* the stack taking its time must not hold up giving up */
+	start = g_get_monotonic_time ();
+	g_assert_false (gs_auth_verify_user (g_get_user_name (), NULL, answer_cb, &conversation, cancellable, &error));
+	g_assert_error (error, GS_AUTH_ERROR, GS_AUTH_ERROR_CANCELLED);
+	g_assert_cmpint (g_get_monotonic_time () - start, <, 5 * G_USEC_PER_SEC);
+
+	g_error_free (error);
+	g_object_unref (cancellable);
+}
+
+/* the second factor gets there while the password prompt is up */
+static void
+test_secondary_wins (void)
+{
+	Conversation conversation = { NULL, 0, 0, FALSE };
+	GError      *error = NULL;
+
+	mock_reset ();
+	g_setenv ("GS_AUTH_MOCK_SECONDARY_LATENCY", "20", TRUE);
+
+	g_assert_true (gs_auth_verify_user (g_get_user_name (), NULL, answer_cb, &conversation, NULL, &error));
+	g_assert_no_error (error);
+	g_assert_cmpuint (conversation.n_prompts, ==, 1);
+	g_assert_true (conversation.cancelled);
+}
+
+/* the password gets there first, and the second factor is not waited for */
+static void
+test_password_wins (void)
+{
+	Conversation conversation = { "secret", 0, 0, FALSE };
+	GError      *error = NULL;
+	gint64       start;
+
+	mock_reset ();
+	g_setenv ("GS_AUTH_MOCK_SECONDARY_LATENCY", "10000", TRUE);
+
+	start = g_get_monotonic_time ();
+	g_assert_true (gs_auth_verify_user (g_get_user_name (), NULL, answer_cb, &conversation, NULL, &error));
+	g_assert_no_error (error);
+	g_assert_false (conversation.cancelled);
+	g_assert_cmpint (g_get_monotonic_time () - start, <, 5 * G_USEC_PER_SEC);
+
+	/* nor does it report in late */
+	g_assert_false (g_main_context_iteration (NULL, FALSE));
+}
+
+/* a wrong password doesn't stop the second factor from winning */
+static void
+test_wrong_password_secondary_wins (void)
+{
+	Conversation conversation = { "guess", 0, 0, FALSE };
+	GError      *error = NULL;
+
+	mock_reset ();
+	g_setenv ("GS_AUTH_MOCK_LATENCY", "10000", TRUE);
+	g_setenv ("GS_AUTH_MOCK_SECONDARY_LATENCY", "20", TRUE);
+
+	g_assert_true (gs_auth_verify_user (g_get_user_name (), NULL, answer_cb, &conversation, NULL, &error));
+	g_assert_no_error (error);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	gs_auth_use_backend (&gs_auth_mock_backend);
+
+	g_test_add_func ("/auth/mock/backend", test_backend);
+	g_test_add_func ("/auth/mock/right-password", test_right_password);
+	g_test_add_func ("/auth/mock/wrong-password", test_wrong_password);
+	g_test_add_func ("/auth/mock/prompts", test_prompts);
+	g_test_add_func ("/auth/mock/cancelled", test_cancelled);
+	g_test_add_func ("/auth/mock/secondary/secondary-wins", test_secondary_wins);
+	g_test_add_func ("/auth/mock/secondary/password-wins", test_password_wins);
+	g_test_add_func ("/auth/mock/secondary/wrong-password", test_wrong_password_secondary_wins);
+
+	return g_test_run ();
+}
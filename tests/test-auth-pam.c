@@ -0,0 +1,339 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Exercises how the PAM backend runs the password and a second factor
+ * side by side: which one wins, which one is told to stop and what is
+ * kept for the next attempt.  The backend is built into this file with
+ * a second service whether or not one was configured.  No worker
+ * thread is ever started, the tests pop the queued requests themselves
+ * and hand them back the way a worker does once its stack returns, so
+ * no PAM module is involved.
+ */
+
+#include "config.h"
+
+#ifndef SECONDARY_PAM_SERVICE
+#define SECONDARY_PAM_SERVICE "test-secondary"
+#endif
+
+#include "../src/gs-auth-pam.c"
+
+/* does what gs_auth_worker_func() does with a request once the stack
+ * has returned status for it */
+static void
+worker_finish (GSAuthWorker *worker,
+	       int           status)
+{
+	GSAuthRequest *request;
+
+	request = g_async_queue_try_pop (worker->queue);
+	g_assert_nonnull (request);
+
+	request->status = status;
+	g_idle_add ((GSourceFunc) gs_auth_request_complete_idle, request);
+}
+
+static gboolean
+password_fails_idle (gpointer data)
+{
+	(void) data;
+
+	worker_finish (&password_worker, PAM_AUTH_ERR);
+
+	return FALSE;
+}
+
+static gboolean
+password_succeeds_idle (gpointer data)
+{
+	(void) data;
+
+	worker_finish (&password_worker, PAM_SUCCESS);
+
+	return FALSE;
+}
+
+static gboolean
+secondary_succeeds_idle (gpointer data)
+{
+	(void) data;
+
+	worker_finish (&secondary_worker, PAM_SUCCESS);
+
+	return FALSE;
+}
+
+static gboolean
+cancel_idle (GCancellable *cancellable)
+{
+	g_cancellable_cancel (cancellable);
+
+	return FALSE;
+}
+
+/* an attempt as the dialog makes one, short of the prompts */
+static gboolean
+verify (GError **error)
+{
+	GCancellable *cancellable;
+	gboolean      res;
+
+	cancellable = g_cancellable_new ();
+	res = gs_auth_pam_verify_user (g_get_user_name (), NULL, NULL, NULL, cancellable, error);
+	g_object_unref (cancellable);
+
+	return res;
+}
+
+static void
+run_pending (void)
+{
+	while (g_main_context_iteration (NULL, FALSE));
+}
+
+static void
+unlocked_cb (gpointer data)
+{
+	guint *n_unlocked = data;
+
+	(*n_unlocked)++;
+}
+
+/* stands in for the workers, and forgets what the last test left */
+static void
+setup_workers (void)
+{
+	GSAuthWorker  *workers [] = { &password_worker, &secondary_worker };
+	GSAuthRequest *request;
+	guint          i;
+
+	run_pending ();
+
+	for (i = 0; i < G_N_ELEMENTS (workers); i++) {
+		if (workers [i]->queue == NULL) {
+			workers [i]->queue = g_async_queue_new ();
+			workers [i]->thread = g_thread_self ();
+		}
+
+		while ((request = g_async_queue_try_pop (workers [i]->queue)) != NULL) {
+			gs_auth_request_unref (request);
+		}
+	}
+
+	if (secondary_request != NULL) {
+		gs_auth_drop_secondary ();
+	}
+
+	secondary_unlock_func = NULL;
+	secondary_unlock_data = NULL;
+}
+
+/* the password request the verify left queued, which was told to stop */
+static void
+assert_password_abandoned (void)
+{
+	GSAuthRequest *request;
+
+	request = g_async_queue_try_pop (password_worker.queue);
+	g_assert_nonnull (request);
+	g_assert_true (g_atomic_int_get (&request->cancelled));
+	g_assert_true (g_cancellable_is_cancelled (request->cancellable));
+	gs_auth_request_unref (request);
+}
+
+static void
+test_secondary_cancels_password (void)
+{
+	GError *error = NULL;
+
+	setup_workers ();
+
+	g_idle_add (secondary_succeeds_idle, NULL);
+	g_assert_true (verify (&error));
+	g_assert_no_error (error);
+
+	assert_password_abandoned ();
+	g_assert_null (secondary_request);
+}
+
+static void
+test_password_cancels_secondary (void)
+{
+	GSAuthRequest *secondary;
+	GError        *error = NULL;
+
+	setup_workers ();
+
+	g_idle_add (password_succeeds_idle, NULL);
+	g_assert_true (verify (&error));
+	g_assert_no_error (error);
+
+	secondary = secondary_request;
+	g_assert_nonnull (secondary);
+	g_assert_true (g_atomic_int_get (&secondary->cancelled));
+	g_assert_null (secondary->loop);
+	g_assert_null (secondary->sibling);
+
+	/* a cancelled one is never picked up again */
+	g_assert_true (gs_auth_start_secondary (g_get_user_name (), NULL) != secondary);
+	g_assert_cmpint (g_async_queue_length (secondary_worker.queue), ==, 2);
+}
+
+static void
+test_secondary_kept_after_failure (void)
+{
+	GSAuthRequest *secondary;
+	GError        *error = NULL;
+
+	setup_workers ();
+
+	g_idle_add (password_fails_idle, NULL);
+	g_assert_false (verify (&error));
+	g_assert_error (error, GS_AUTH_ERROR, GS_AUTH_ERROR_AUTH_ERROR);
+	g_clear_error (&error);
+
+	/* still listening, and no longer tied to the attempt */
+	secondary = secondary_request;
+	g_assert_nonnull (secondary);
+	g_assert_false (g_atomic_int_get (&secondary->cancelled));
+	g_assert_false (secondary->done);
+	g_assert_null (secondary->loop);
+	g_assert_null (secondary->sibling);
+
+	/* the next attempt picks the same one up instead of queueing */
+	g_assert_true (gs_auth_start_secondary (g_get_user_name (), NULL) == secondary);
+	g_assert_cmpint (g_async_queue_length (secondary_worker.queue), ==, 1);
+
+	/* but not for another display */
+	g_assert_true (gs_auth_start_secondary (g_get_user_name (), ":1") != secondary);
+	g_assert_cmpint (g_async_queue_length (secondary_worker.queue), ==, 2);
+}
+
+static void
+test_secondary_wins_before_loop (void)
+{
+	GSAuthRequest *secondary;
+	GError        *error = NULL;
+
+	setup_workers ();
+
+	secondary = gs_auth_start_secondary (g_get_user_name (), NULL);
+	g_assert_nonnull (secondary);
+
+	/* done before any attempt, with nobody to tell */
+	worker_finish (&secondary_worker, PAM_SUCCESS);
+	run_pending ();
+	g_assert_true (secondary_request == secondary);
+	g_assert_true (secondary->done);
+
+	g_assert_true (verify (&error));
+	g_assert_no_error (error);
+
+	assert_password_abandoned ();
+	g_assert_null (secondary_request);
+}
+
+static void
+test_secondary_unlocks_between_attempts (void)
+{
+	GSAuthRequest *secondary;
+	GError        *error = NULL;
+	gint64         started;
+	guint          n_unlocked = 0;
+
+	setup_workers ();
+
+	gs_auth_pam_start_second_factor (g_get_user_name (), NULL, unlocked_cb, &n_unlocked);
+	secondary = secondary_request;
+	g_assert_nonnull (secondary);
+	started = secondary->timeline.started;
+
+	g_idle_add (password_fails_idle, NULL);
+	g_assert_false (verify (&error));
+	g_clear_error (&error);
+	g_assert_cmpuint (n_unlocked, ==, 0);
+
+	/* in the wait after the failure, with no loop running */
+	worker_finish (&secondary_worker, PAM_SUCCESS);
+	run_pending ();
+
+	g_assert_cmpuint (n_unlocked, ==, 1);
+	g_assert_null (secondary_request);
+	g_assert_cmpint (last_timeline.started, ==, started);
+}
+
+static void
+test_secondary_unlocks_before_first_attempt (void)
+{
+	guint n_unlocked = 0;
+
+	setup_workers ();
+
+	gs_auth_pam_start_second_factor (g_get_user_name (), NULL, unlocked_cb, &n_unlocked);
+
+	worker_finish (&secondary_worker, PAM_SUCCESS);
+	run_pending ();
+
+	g_assert_cmpuint (n_unlocked, ==, 1);
+	g_assert_null (secondary_request);
+}
+
+static void
+test_cancelled_secondary_does_not_unlock (void)
+{
+	GCancellable *cancellable;
+	GError       *error = NULL;
+	guint         n_unlocked = 0;
+
+	setup_workers ();
+
+	gs_auth_pam_start_second_factor (g_get_user_name (), NULL, unlocked_cb, &n_unlocked);
+
+	/* the dialog goes away in the middle of an attempt */
+	cancellable = g_cancellable_new ();
+	g_idle_add ((GSourceFunc) cancel_idle, cancellable);
+	g_assert_false (gs_auth_pam_verify_user (g_get_user_name (), NULL, NULL, NULL, cancellable, &error));
+	g_assert_error (error, GS_AUTH_ERROR, GS_AUTH_ERROR_CANCELLED);
+	g_clear_error (&error);
+	g_object_unref (cancellable);
+
+	/* and the fingerprint comes in late */
+	worker_finish (&secondary_worker, PAM_SUCCESS);
+	run_pending ();
+
+	g_assert_cmpuint (n_unlocked, ==, 0);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/auth/pam/secondary/cancels-password", test_secondary_cancels_password);
+	g_test_add_func ("/auth/pam/secondary/cancelled-by-password", test_password_cancels_secondary);
+	g_test_add_func ("/auth/pam/secondary/kept-after-failure", test_secondary_kept_after_failure);
+	g_test_add_func ("/auth/pam/secondary/wins-before-loop", test_secondary_wins_before_loop);
+	g_test_add_func ("/auth/pam/secondary/unlocks-between-attempts", test_secondary_unlocks_between_attempts);
+	g_test_add_func ("/auth/pam/secondary/unlocks-before-first-attempt", test_secondary_unlocks_before_first_attempt);
+	g_test_add_func ("/auth/pam/secondary/cancelled-does-not-unlock", test_cancelled_secondary_does_not_unlock);
+
+	return g_test_run ();
+}
@@ -0,0 +1,190 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gs-premultiply.h"
+
+/* The converter gs-lock-plug.c used before the table, a divide per
+ * channel, kept here as the reference the kernel must match exactly. */
+static void
+reference_unpremultiply (guint8       *dst,
+			 const guint8 *src,
+			 int           width,
+			 int           height,
+			 int           rowstride)
+{
+	int          i, j;
+	unsigned int t;
+
+#define MULT(d,c,a,t) G_STMT_START { t = (a)? c * 255 / a: 0; d = t;} G_STMT_END
+
+	for (i = 0; i < height; i++) {
+		for (j = 0; j < width; j++) {
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+			MULT(dst[0], src[2], src[3], t);
+			MULT(dst[1], src[1], src[3], t);
+			MULT(dst[2], src[0], src[3], t);
+			dst[3] = src[3];
+#else
+			MULT(dst[0], src[1], src[0], t);
+			MULT(dst[1], src[2], src[0], t);
+			MULT(dst[2], src[3], src[0], t);
+			dst[3] = src[0];
+#endif
+			src += 4;
+			dst += 4;
+		}
+		src += rowstride - width * 4;
+		dst += rowstride - width * 4;
+	}
+#undef MULT
+}
+
+/* every colour value against every alpha, the out of range c > a ones
+ * that slightly broken premultiplied data has included: a 256x256 image
+ * with c along the rows and a along the columns, on a padded stride */
+static guint8 *
+make_ramp (int *width,
+	   int *height,
+	   int *rowstride)
+{
+	guint8 *data;
+	int     c, a;
+
+	*width = 256;
+	*height = 256;
+	*rowstride = 256 * 4 + 16;
+
+	data = g_malloc0 (*rowstride * *height);
+
+	for (c = 0; c < 256; c++) {
+		for (a = 0; a < 256; a++) {
+			guint32 pixel;
+			guint8  g = (c * 7 + a) & 0xff;
+			guint8  b = 255 - c;
+
+			pixel = ((guint32) a << 24) | ((guint32) c << 16) | ((guint32) g << 8) | b;
+			memcpy (data + c * *rowstride + a * 4, &pixel, sizeof (pixel));
+		}
+	}
+
+	return data;
+}
+
+static void
+assert_rows_equal (const guint8 *a,
+		   const guint8 *b,
+		   int           width,
+		   int           height,
+		   int           rowstride)
+{
+	int i;
+
+	for (i = 0; i < height; i++) {
+		g_assert_cmpmem (a + i * rowstride, width * 4, b + i * rowstride, width * 4);
+	}
+}
+
+static void
+test_copy (void)
+{
+	guint8 *src;
+	guint8 *expected;
+	guint8 *actual;
+	int     width, height, rowstride;
+
+	src = make_ramp (&width, &height, &rowstride);
+	expected = g_malloc0 (rowstride * height);
+	actual = g_malloc0 (rowstride * height);
+
+	reference_unpremultiply (expected, src, width, height, rowstride);
+	gs_unpremultiply_argb32 (actual, rowstride, src, rowstride, width, height);
+
+	assert_rows_equal (expected, actual, width, height, rowstride);
+
+	g_free (src);
+	g_free (expected);
+	g_free (actual);
+}
+
+static void
+test_in_place (void)
+{
+	guint8 *src;
+	guint8 *expected;
+	int     width, height, rowstride;
+
+	src = make_ramp (&width, &height, &rowstride);
+	expected = g_malloc0 (rowstride * height);
+
+	reference_unpremultiply (expected, src, width, height, rowstride);
+	gs_unpremultiply_argb32 (src, rowstride, NULL, 0, width, height);
+
+	assert_rows_equal (expected, src, width, height, rowstride);
+
+	g_free (src);
+	g_free (expected);
+}
+
+/* different strides on either side, as a pixbuf's may be */
+static void
+test_strides (void)
+{
+	guint8 *src;
+	guint8 *expected;
+	guint8 *actual;
+	int     width, height, rowstride;
+	int     dst_stride;
+	int     i;
+
+	src = make_ramp (&width, &height, &rowstride);
+	expected = g_malloc0 (rowstride * height);
+	reference_unpremultiply (expected, src, width, height, rowstride);
+
+	dst_stride = width * 4;
+	actual = g_malloc0 (dst_stride * height);
+	gs_unpremultiply_argb32 (actual, dst_stride, src, rowstride, width, height);
+
+	for (i = 0; i < height; i++) {
+		g_assert_cmpmem (expected + i * rowstride, width * 4, actual + i * dst_stride, width * 4);
+	}
+
+	g_free (src);
+	g_free (expected);
+	g_free (actual);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/premultiply/copy", test_copy);
+	g_test_add_func ("/premultiply/in-place", test_in_place);
+	g_test_add_func ("/premultiply/strides", test_strides);
+
+	return g_test_run ();
+}
@@ -0,0 +1,353 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2026 Buddies of Budgie
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "gs-auth.h"
+#include "gs-auth-backend.h"
+#include "gs-lock-plug.h"
+#include "gs-secure-entry-buffer.h"
+
+/* Checks that typing into the password entry never leaves a copy of
+ * the password on the heap, on its own and on the whole way from the
+ * lock plug to the backend's answer.  The secure buffer keeps its text in a
+ * locked mapping of its own, so any heap block that ever holds the
+ * password is a leak.  malloc and friends are interposed here to
+ * follow every block allocated while text is inserted and deleted:
+ * each one is searched as it is freed or reallocated, and whatever is
+ * still alive once the text is gone.  GtkEntryBuffer's own buffer is
+ * put through the same to show that the search does find copies.
+ *
+ * This relies on glibc exporting its allocator as __libc_malloc & co.
+ * Allocations libc makes for itself don't go through these, but glib
+ * and gtk get all their memory from malloc.
+ */
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void  __libc_free (void *ptr);
+
+#define PASSWORD   "c0rrect-h0rse-battery"
+#define MAX_BLOCKS 16384
+
+/* a ceiling for one unlock attempt, well above what it takes: getting
+ * past it means something on the way has started allocating per key
+ * or per attempt again */
+#define MAX_ATTEMPT_ALLOCATIONS 1024
+
+typedef struct {
+	void  *ptr;
+	size_t size;
+} Block;
+
+/* only the test's own thread is followed, so none of this is locked */
+static _Thread_local gboolean tracking = FALSE;
+
+static Block    blocks [MAX_BLOCKS];
+static guint    n_blocks = 0;
+static gboolean overflowed = FALSE;
+static guint    n_allocations = 0;
+static guint    n_copies = 0;
+
+static gboolean
+block_has_password (const Block *block)
+{
+	const char *data = block->ptr;
+	size_t      len = strlen (PASSWORD);
+	size_t      i;
+
+	for (i = 0; i + len <= block->size; i++) {
+		if (memcmp (data + i, PASSWORD, len) == 0) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+track (void  *ptr,
+       size_t size)
+{
+	if (ptr == NULL) {
+		return;
+	}
+
+	n_allocations++;
+
+	if (n_blocks == MAX_BLOCKS) {
+		overflowed = TRUE;
+		return;
+	}
+
+	blocks [n_blocks].ptr = ptr;
+	blocks [n_blocks].size = size;
+	n_blocks++;
+}
+
+/* searches a block on its way out and stops following it */
+static void
+untrack (void *ptr)
+{
+	guint i;
+
+	if (ptr == NULL) {
+		return;
+	}
+
+	for (i = 0; i < n_blocks; i++) {
+		if (blocks [i].ptr == ptr) {
+			if (block_has_password (&blocks [i])) {
+				n_copies++;
+			}
+			blocks [i] = blocks [--n_blocks];
+			return;
+		}
+	}
+}
+
+void *
+malloc (size_t size)
+{
+	void *ptr = __libc_malloc (size);
+
+	if (tracking) {
+		track (ptr, size);
+	}
+
+	return ptr;
+}
+
+void *
+calloc (size_t n_members,
+	size_t size)
+{
+	void *ptr = __libc_calloc (n_members, size);
+
+	if (tracking) {
+		track (ptr, n_members * size);
+	}
+
+	return ptr;
+}
+
+void *
+realloc (void  *ptr,
+	 size_t size)
+{
+	void *new_ptr;
+
+	if (tracking) {
+		untrack (ptr);
+	}
+
+	new_ptr = __libc_realloc (ptr, size);
+
+	if (tracking) {
+		track (new_ptr, size);
+	}
+
+	return new_ptr;
+}
+
+void
+free (void *ptr)
+{
+	if (tracking) {
+		untrack (ptr);
+	}
+
+	__libc_free (ptr);
+}
+
+static void
+tracking_start (void)
+{
+	n_blocks = 0;
+	overflowed = FALSE;
+	n_allocations = 0;
+	n_copies = 0;
+	tracking = TRUE;
+}
+
+static void
+tracking_stop (void)
+{
+	guint i;
+
+	tracking = FALSE;
+
+	for (i = 0; i < n_blocks; i++) {
+		if (block_has_password (&blocks [i])) {
+			n_copies++;
+		}
+	}
+	n_blocks = 0;
+}
+
+/* types the password one key at a time, pastes it over the top, then
+ * backspaces everything away */
+static void
+exercise (GtkEntryBuffer *buffer)
+{
+	const char *password = PASSWORD;
+	guint       i;
+
+	for (i = 0; password [i] != '\0'; i++) {
+		gtk_entry_buffer_insert_text (buffer, i, password + i, 1);
+	}
+
+	gtk_entry_buffer_delete_text (buffer, 0, -1);
+	gtk_entry_buffer_insert_text (buffer, 0, password, -1);
+
+	while (gtk_entry_buffer_get_length (buffer) > 0) {
+		gtk_entry_buffer_delete_text (buffer, gtk_entry_buffer_get_length (buffer) - 1, 1);
+	}
+}
+
+static void
+test_secure_buffer (void)
+{
+	GtkEntryBuffer *buffer;
+
+	buffer = gs_secure_entry_buffer_new ();
+
+	tracking_start ();
+	exercise (buffer);
+	tracking_stop ();
+
+	g_test_message ("%u allocations while typing", n_allocations);
+	g_assert_false (overflowed);
+	g_assert_cmpuint (n_copies, ==, 0);
+
+	g_object_unref (buffer);
+}
+
+/* the plain buffer keeps its text on the heap, so it must be caught */
+static void
+test_plain_buffer (void)
+{
+	GtkEntryBuffer *buffer;
+
+	buffer = gtk_entry_buffer_new (NULL, 0);
+
+	tracking_start ();
+	gtk_entry_buffer_insert_text (buffer, 0, PASSWORD, -1);
+	tracking_stop ();
+
+	g_assert_false (overflowed);
+	g_assert_cmpuint (n_copies, >, 0);
+
+	g_object_unref (buffer);
+}
+
+/* answers a prompt the way the dialog's request_response() does,
+ * short of running the plug: the password arrives as typeahead */
+static gboolean
+auth_message_handler (GSAuthMessageStyle style,
+		      const char        *msg,
+		      GSSecureBuffer    *response,
+		      GCancellable      *cancellable,
+		      gpointer           data)
+{
+	GSLockPlug *plug = data;
+	gboolean    ret;
+
+	(void) cancellable;
+
+	if (style != GS_AUTH_MESSAGE_PROMPT_ECHO_OFF) {
+		return TRUE;
+	}
+
+	gs_lock_plug_set_sensitive (plug, TRUE);
+	gs_lock_plug_enable_prompt (plug, msg, FALSE);
+	gs_lock_plug_set_typeahead (plug, PASSWORD, FALSE);
+
+	ret = gs_lock_plug_get_text (plug, response);
+	gs_lock_plug_disable_prompt (plug);
+
+	return ret;
+}
+
+/* one attempt against the mock backend, from the entry to the reply */
+static void
+test_unlock_attempt (gconstpointer data)
+{
+	gboolean      have_display = GPOINTER_TO_INT (data);
+	GtkWidget    *plug;
+	GCancellable *cancellable;
+	GError       *error = NULL;
+	gboolean      res;
+
+	if (! have_display) {
+		g_test_skip ("the lock plug needs a display");
+		return;
+	}
+
+	gs_auth_use_backend (&gs_auth_mock_backend);
+	g_setenv ("GS_AUTH_MOCK_PASSWORD", PASSWORD, TRUE);
+
+	/* never shown, which would look the user's face up on the bus */
+	plug = gs_lock_plug_new ();
+	cancellable = g_cancellable_new ();
+
+	tracking_start ();
+	res = gs_auth_verify_user (g_get_user_name (),
+				   NULL,
+				   auth_message_handler,
+				   plug,
+				   cancellable,
+				   &error);
+	tracking_stop ();
+
+	g_assert_no_error (error);
+	g_assert_true (res);
+
+	g_test_message ("%u allocations in the attempt", n_allocations);
+	g_assert_false (overflowed);
+	g_assert_cmpuint (n_copies, ==, 0);
+	g_assert_cmpuint (n_allocations, <=, MAX_ATTEMPT_ALLOCATIONS);
+
+	g_object_unref (cancellable);
+	gtk_widget_destroy (plug);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	gboolean have_display;
+
+	g_test_init (&argc, &argv, NULL);
+	have_display = gtk_init_check (&argc, &argv);
+
+	g_test_add_func ("/secure-entry-buffer/no-heap-copies", test_secure_buffer);
+	g_test_add_func ("/secure-entry-buffer/plain-buffer-is-caught", test_plain_buffer);
+	g_test_add_data_func ("/secure-entry-buffer/unlock-attempt",
+			      GINT_TO_POINTER (have_display),
+			      test_unlock_attempt);
+
+	return g_test_run ();
+}